@@ -33,6 +33,57 @@ extern "C" {
  */
 typedef void (*mgos_wifi_provision_cb_t)(bool last_test_success, const char *ssid, void *userdata);
 
+/*
+ * Radio-on time (in milliseconds) and estimated charge (in uAh) of the last test, per phase.
+ *
+ * Charge is estimated using the `provision.wifi.energy` current model, and is already
+ * updated (except for `reconnect_ms`) when the test callback is called.  Once the previous STA
+ * reconnects, results are updated (and saved) again to include reconnect.
+ */
+struct mgos_provision_wifi_energy {
+  int scan_ms;       // Coexist scan for test network channel (charged at sta_ma)
+  int disconnect_ms; // Preparing test: coexist notice, and disconnecting existing STA (includes settle sleep)
+  int connect_ms;    // Test STA setup until pass/fail result
+  int reconnect_ms;  // Reconnecting to previous STA after failed test (updated after callback, once IP is acquired)
+  int radio_ms;      // Total of all phases
+  int charge;        // Estimated charge of all phases, in uAh
+  int estimate;      // Worst case charge estimate (in uAh) checked against provision.wifi.energy.budget
+  bool aborted;      // Test was not started because estimate exceeded budget, and action is abort
+  bool deferred;     // Test was not started because estimate exceeded budget, and action is defer (ran once estimate fits)
+};
+
+/*
+ * Link quality of the last test, measured after IP is acquired when provision.wifi.quality.enable is true.
+ *
+ * Already updated when the test callback is called.
+ */
+struct mgos_provision_wifi_quality {
+  int rssi;     // Average RSSI of samples (dBm)
+  int rssi_min; // Lowest sampled RSSI (dBm)
+  int samples;  // Number of RSSI samples taken
+  int rtt;      // Round trip to gateway in ms, -1 when not measured or probe failed
+  bool weak;    // No RSSI samples, RSSI below provision.wifi.quality.min_rssi, or round trip above provision.wifi.quality.max_rtt
+};
+
+/*
+ * SoftAP channel coexistence of the last test, when provision.wifi.coexist.enable is true.
+ *
+ * Portal client measurements cover the time from coexist scan until the test result.
+ */
+struct mgos_provision_wifi_coexist {
+  int prev_channel;   // AP channel before test
+  int target_channel; // Channel of test network from scan, 0 when not found
+  bool moved;         // AP was moved to target channel
+  int disconnects;    // Portal client disconnects from AP
+  int reassoc_ms;     // Total time portal clients took to re-associate, in ms
+};
+
+/*
+ * Callback prototype for `mgos_provision_wifi_set_notice_cb()`, called before AP is moved to `channel`,
+ * `delay_ms` before the move happens, so portal clients can be told to expect a short disconnect.
+ */
+typedef void (*mgos_provision_wifi_notice_cb_t)(int channel, int delay_ms, void *userdata);
+
 /*
  * Connect to the previously setup wifi station (with `mgos_wifi_setup_sta()`).
  */
@@ -127,6 +178,73 @@ bool mgos_provision_wifi_is_test_running(void);
  */
 const char *mgos_provision_wifi_get_last_test_ssid(void);
 
+/*
+ * Get radio-on time and estimated charge of the last (or currently running) test
+ */
+const struct mgos_provision_wifi_energy *mgos_provision_wifi_get_last_test_energy(void);
+
+/*
+ * Get reason last test was not ran, empty when test ran (budget_abort, budget_defer)
+ */
+const char *mgos_provision_wifi_get_last_test_reason(void);
+
+/*
+ * Get last test radio-on time in milliseconds (persisted in provision.wifi.results.radio_ms)
+ */
+int mgos_provision_wifi_get_last_test_radio_ms(void);
+
+/*
+ * Get last test estimated charge in uAh (persisted in provision.wifi.results.charge)
+ */
+int mgos_provision_wifi_get_last_test_charge(void);
+
+/*
+ * Get last test time in milliseconds to reconnect previous STA after failure (persisted in provision.wifi.results.reconnect_ms)
+ *
+ * This is 0 when the test callback is called, and is set (and included in radio-on time and charge) once IP is acquired
+ */
+int mgos_provision_wifi_get_last_test_reconnect_ms(void);
+
+/*
+ * Get link quality measurements of the last (or currently running) test
+ */
+const struct mgos_provision_wifi_quality *mgos_provision_wifi_get_last_test_quality(void);
+
+/*
+ * Get last test average RSSI in dBm (persisted in provision.wifi.results.rssi, 0 when not measured)
+ */
+int mgos_provision_wifi_get_last_test_rssi(void);
+
+/*
+ * Get last test gateway round trip in ms (persisted in provision.wifi.results.rtt, -1 when not measured)
+ */
+int mgos_provision_wifi_get_last_test_rtt(void);
+
+/*
+ * Get whether last test link was marked as weak (persisted in provision.wifi.results.weak)
+ */
+bool mgos_provision_wifi_get_last_test_weak(void);
+
+/*
+ * Get SoftAP channel coexistence results of the last (or currently running) test
+ */
+const struct mgos_provision_wifi_coexist *mgos_provision_wifi_get_last_test_coexist(void);
+
+/*
+ * Get last test portal client disconnects (persisted in provision.wifi.results.ap_disconnects)
+ */
+int mgos_provision_wifi_get_last_test_ap_disconnects(void);
+
+/*
+ * Get last test portal client re-association time in ms (persisted in provision.wifi.results.reassoc_ms)
+ */
+int mgos_provision_wifi_get_last_test_reassoc_ms(void);
+
+/*
+ * Set callback called before AP channel is moved (provision.wifi.coexist.enable), pass NULL to remove
+ */
+void mgos_provision_wifi_set_notice_cb(mgos_provision_wifi_notice_cb_t cb, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -12,8 +12,18 @@ let ProvisionWiFi = {
     Results: {
         success: ffi('bool mgos_provision_wifi_get_last_test_results(void)'),
         ssid: ffi('char *mgos_provision_wifi_get_last_test_ssid(void)'),
+        reason: ffi('char *mgos_provision_wifi_get_last_test_reason(void)'),
+        radioTime: ffi('int mgos_provision_wifi_get_last_test_radio_ms(void)'),
+        charge: ffi('int mgos_provision_wifi_get_last_test_charge(void)'),
+        reconnectTime: ffi('int mgos_provision_wifi_get_last_test_reconnect_ms(void)'),
+        rssi: ffi('int mgos_provision_wifi_get_last_test_rssi(void)'),
+        rtt: ffi('int mgos_provision_wifi_get_last_test_rtt(void)'),
+        weak: ffi('bool mgos_provision_wifi_get_last_test_weak(void)'),
+        apDisconnects: ffi('int mgos_provision_wifi_get_last_test_ap_disconnects(void)'),
+        reassocTime: ffi('int mgos_provision_wifi_get_last_test_reassoc_ms(void)'),
         // check: ffi(''), // TODO: allow passing SSID to check if last test was for SSID and return results
     },
+    onChannelNotice: ffi('void mgos_provision_wifi_set_notice_cb(void(*)(int,int,userdata),userdata)'),
     isRunning: ffi( 'bool mgos_provision_wifi_is_test_running(void)'),
     Test: {
         run: ffi('void mgos_provision_wifi_test(void(*)(int,char*,userdata),userdata)'),
@@ -18,8 +18,10 @@
 #include "mgos_provision_wifi.h"
 #include "mgos_provision_wifi_hal.h"
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "common/cs_dbg.h"
 // #include "common/queue.h"
@@ -31,6 +33,7 @@
 #include "mgos_system.h"
 
 #include "mgos_mongoose.h"
+#include "mgos_net.h"
 #include "mgos_net_hal.h"
 
 #include "mongoose.h"
@@ -45,6 +48,31 @@ static bool b_provision_wifi_testing = false;
 static bool s_sta_should_reconnect = false;
 static bool b_sta_was_connected = false;
 
+enum mgos_provision_wifi_energy_phase {
+  MGOS_PROVISION_WIFI_PHASE_SCAN,
+  MGOS_PROVISION_WIFI_PHASE_DISCONNECT,
+  MGOS_PROVISION_WIFI_PHASE_CONNECT,
+  MGOS_PROVISION_WIFI_PHASE_RECONNECT,
+};
+
+static struct mgos_provision_wifi_energy s_provision_wifi_energy;
+static double s_energy_phase_start = 0;
+static bool b_energy_deferred_run = false;
+
+static struct mgos_provision_wifi_quality s_provision_wifi_quality;
+static mgos_timer_id s_provision_wifi_quality_timer_id = MGOS_INVALID_TIMER_ID;
+static struct mg_connection *s_quality_nc = NULL;
+static double s_quality_start = 0;
+static int s_quality_rssi_total = 0;
+static int s_quality_ticks = 0;
+
+static struct mgos_provision_wifi_coexist s_provision_wifi_coexist;
+static mgos_provision_wifi_notice_cb_t s_provision_wifi_notice_cb = NULL;
+static void *s_provision_wifi_notice_cb_userdata = NULL;
+static mgos_timer_id s_provision_wifi_notice_timer_id = MGOS_INVALID_TIMER_ID;
+static mgos_timer_id s_provision_wifi_scan_timer_id = MGOS_INVALID_TIMER_ID;
+static double s_coexist_disconnected_at = 0;
+
 struct mgos_rlock_type *s_provision_wifi_lock = NULL;
 
 static inline void wifi_lock(void) {
@@ -57,29 +85,155 @@ static inline void wifi_unlock(void) {
 
 static bool mgos_provision_wifi_enable_net_cb();
 static bool mgos_provision_wifi_disable_net_cb();
+static void mgos_provision_wifi_energy_reconnect_net_cb(int ev, void *evd, void *arg);
+static void mgos_provision_wifi_energy_defer_net_cb(int ev, void *evd, void *arg);
+static void mgos_provision_wifi_quality_stop(void);
+static void mgos_provision_wifi_coexist_stop(void);
+static bool mgos_provision_wifi_coexist_enabled(void);
+static void mgos_provision_wifi_start_test(void);
+static bool mgos_provision_wifi_copy_sta_cfg(void);
+static void mgos_provision_wifi_clear_sta_cfg(void);
+static bool mgos_provision_wifi_save_results(void);
+
+static void mgos_provision_wifi_energy_reset(void){
+  mgos_event_remove_group_handler(MGOS_EVENT_GRP_NET, mgos_provision_wifi_energy_reconnect_net_cb, NULL);
+  mgos_event_remove_group_handler(MGOS_EVENT_GRP_NET, mgos_provision_wifi_energy_defer_net_cb, NULL);
+  memset(&s_provision_wifi_energy, 0, sizeof(s_provision_wifi_energy));
+}
+
+static void mgos_provision_wifi_energy_begin(void){
+  s_energy_phase_start = mgos_uptime();
+}
+
+static void mgos_provision_wifi_energy_end(enum mgos_provision_wifi_energy_phase phase){
+  int ms = (int) ((mgos_uptime() - s_energy_phase_start) * 1000);
+  int ma = mgos_sys_config_get_provision_wifi_energy_sta_ma();
+
+  switch (phase) {
+    case MGOS_PROVISION_WIFI_PHASE_SCAN:
+      // Radio is actively scanning, same current as estimated in mgos_provision_wifi_energy_estimate()
+      s_provision_wifi_energy.scan_ms += ms;
+      break;
+    case MGOS_PROVISION_WIFI_PHASE_DISCONNECT:
+      s_provision_wifi_energy.disconnect_ms += ms;
+      ma = mgos_sys_config_get_provision_wifi_energy_idle_ma();
+      break;
+    case MGOS_PROVISION_WIFI_PHASE_CONNECT:
+      s_provision_wifi_energy.connect_ms += ms;
+      break;
+    case MGOS_PROVISION_WIFI_PHASE_RECONNECT:
+      s_provision_wifi_energy.reconnect_ms += ms;
+      break;
+  }
+
+  // mA * ms / 3600 = uAh
+  s_provision_wifi_energy.radio_ms += ms;
+  s_provision_wifi_energy.charge += (int) (((double) ma * ms) / 3600);
+}
+
+/*
+ * Worst case charge (in uAh) for a test, assuming timeout is reached and previous STA is reconnected
+ */
+static int mgos_provision_wifi_energy_estimate(bool sta_connected){
+  double uah = 0;
+  int sta_ma = mgos_sys_config_get_provision_wifi_energy_sta_ma();
+
+  if( sta_connected ){
+    uah += (double) mgos_sys_config_get_provision_wifi_energy_idle_ma() * 1000; // Settle sleep after disconnect
+    if( mgos_sys_config_get_provision_wifi_reconnect() ){
+      uah += (double) sta_ma * mgos_sys_config_get_provision_wifi_energy_reconnect() * 1000;
+    }
+  }
+
+  if( mgos_provision_wifi_coexist_enabled() ){
+    int scan_timeout = mgos_sys_config_get_provision_wifi_coexist_scan_timeout();
+    uah += (double) sta_ma * (scan_timeout > 0 ? scan_timeout : 1) * 1000; // Scan for target channel (same timeout as mgos_provision_wifi_coexist_start())
+    uah += (double) mgos_sys_config_get_provision_wifi_energy_idle_ma() * mgos_sys_config_get_provision_wifi_coexist_notice(); // Notice before moving AP
+  }
+
+  uah += (double) sta_ma * mgos_sys_config_get_provision_wifi_timeout() * 1000;
+  return (int) (uah / 3600);
+}
+
+static void mgos_provision_wifi_energy_reconnect_net_cb(int ev, void *evd, void *arg) {
+  if( ev != MGOS_NET_EV_IP_ACQUIRED ){
+    return;
+  }
+
+  mgos_provision_wifi_energy_end(MGOS_PROVISION_WIFI_PHASE_RECONNECT);
+  LOG(LL_INFO, ("Provision WiFi previous STA reconnected after %d ms, total radio %d ms, estimated %d uAh", s_provision_wifi_energy.reconnect_ms, s_provision_wifi_energy.radio_ms, s_provision_wifi_energy.charge ));
+  mgos_event_remove_group_handler(MGOS_EVENT_GRP_NET, mgos_provision_wifi_energy_reconnect_net_cb, NULL);
+
+  // Results were saved before reconnect started, update totals to include reconnect (single save)
+  mgos_sys_config_set_provision_wifi_results_radio_ms( s_provision_wifi_energy.radio_ms );
+  mgos_sys_config_set_provision_wifi_results_charge( s_provision_wifi_energy.charge );
+  mgos_sys_config_set_provision_wifi_results_reconnect_ms( s_provision_wifi_energy.reconnect_ms );
+  mgos_provision_wifi_save_results();
+
+  (void) evd;
+  (void) arg;
+}
+
+/*
+ * Set all provision.wifi.results values (without saving config)
+ *
+ * `reason` is empty when the test ran, otherwise why the test was not ran (budget_abort, budget_defer)
+ */
+static void mgos_provision_wifi_store_results(bool last_test_results, const char *reason){
+  mgos_sys_config_set_provision_wifi_results_success(last_test_results); // Set results
+  mgos_sys_config_set_provision_wifi_results_reason( reason );
+  mgos_sys_config_set_provision_wifi_results_ssid( mgos_sys_config_get_provision_wifi_sta_ssid() ); // Set SSID
+  mgos_sys_config_set_provision_wifi_results_radio_ms( s_provision_wifi_energy.radio_ms );
+  mgos_sys_config_set_provision_wifi_results_charge( s_provision_wifi_energy.charge );
+  mgos_sys_config_set_provision_wifi_results_reconnect_ms( s_provision_wifi_energy.reconnect_ms );
+  mgos_sys_config_set_provision_wifi_results_rssi( s_provision_wifi_quality.rssi );
+  mgos_sys_config_set_provision_wifi_results_rtt( s_provision_wifi_quality.rtt );
+  mgos_sys_config_set_provision_wifi_results_weak( s_provision_wifi_quality.weak );
+  mgos_sys_config_set_provision_wifi_results_ap_disconnects( s_provision_wifi_coexist.disconnects );
+  mgos_sys_config_set_provision_wifi_results_reassoc_ms( s_provision_wifi_coexist.reassoc_ms );
+}
 
 static void mgos_provision_wifi_set_last_test(bool last_test_results){
+  mgos_provision_wifi_energy_end(MGOS_PROVISION_WIFI_PHASE_CONNECT);
+
   // Disable Provision WiFi in configuration
   LOG(LL_INFO, ("Provision WiFi setting last test results to %d", last_test_results));
-  mgos_sys_config_set_provision_wifi_results_success(last_test_results); // Set results
-  mgos_sys_config_set_provision_wifi_results_ssid( mgos_sys_config_get_provision_wifi_sta_ssid() ); // Set SSID
+  LOG(LL_INFO, ("Provision WiFi radio on for %d ms (scan %d ms, disconnect %d ms, connect %d ms), estimated %d uAh", s_provision_wifi_energy.radio_ms, s_provision_wifi_energy.scan_ms, s_provision_wifi_energy.disconnect_ms, s_provision_wifi_energy.connect_ms, s_provision_wifi_energy.charge));
+  mgos_provision_wifi_store_results( last_test_results, "" );
+
+}
 
+/*
+ * Call test callback, this must be the last thing done for a result, as the callback is allowed to
+ * start a new test (which must not be changed by anything left to do for the previous one)
+ */
+static void mgos_provision_wifi_notify_result(bool last_test_results){
   // TODO: add event triggers
   // mgos_event_trigger(MGOS_EVENT_PROVISION_WIFI_TEST_COMPLETE, &test_results); 
 
   if( s_provision_wifi_test_cb != NULL ){
-    s_provision_wifi_test_cb( last_test_results, mgos_sys_config_get_provision_wifi_sta_ssid(), s_provision_wifi_test_cb_userdata );
+    // Results SSID is used as test STA values may already be cleared
+    s_provision_wifi_test_cb( last_test_results, mgos_sys_config_get_provision_wifi_results_ssid(), s_provision_wifi_test_cb_userdata );
   }
+}
 
+/*
+ * Save all config changes made for a test result (only one save per test, to limit flash writes)
+ */
+static bool mgos_provision_wifi_save_results(void){
   char *err = NULL;
   if( ! save_cfg(&mgos_sys_config, &err) ){
-    LOG(LL_ERROR, ("Provision WiFi Set Last Test Results, Save Config Error: %s", err) );
+    LOG(LL_ERROR, ("Provision WiFi Save Test Results, Save Config Error: %s", err) );
     free(err);
-    return;
+    return false;
   }
+
+  return true;
 }
 
 static void mgos_provision_wifi_clear_values(void){
+  mgos_provision_wifi_quality_stop();
+  mgos_provision_wifi_coexist_stop();
   mgos_clear_timer(s_provision_wifi_timer_id);
   s_provision_wifi_timer_id = MGOS_INVALID_TIMER_ID;
   b_provision_wifi_testing = false;
@@ -88,19 +242,32 @@ static void mgos_provision_wifi_clear_values(void){
 
 static void mgos_provision_wifi_connection_failed(void){
 
+  // Only one result per test (timeout, attempts, and quality stage can all end a test)
+  if( ! b_provision_wifi_testing ){
+    LOG(LL_DEBUG, ("%s", "Provision WiFi STA Connection Failed ignored, test not running" ) );
+    return;
+  }
+
   LOG(LL_INFO, ("%s", "Provision WiFi STA Connection Failed!" ) );
   mgos_provision_wifi_clear_values();
-  mgos_provision_wifi_disable_boot_test();
+  mgos_provision_wifi_disable_net_cb();
+
+  // Test STA can still be associated (quality reject, or timeout after association), and must not stay
+  // connected to a failed network, or keep AP on its channel when restoring AP channel below
+  mgos_provision_wifi_disconnect_sta();
+
+  mgos_sys_config_set_provision_wifi_boot_enable( false );
 
   mgos_provision_wifi_set_last_test( false ); // Must be run before clearing STA values (to set SSID)
 
   if( mgos_sys_config_get_provision_wifi_fail_clear() ){
-    mgos_provision_wifi_clear_sta_values();
+    mgos_provision_wifi_clear_sta_cfg();
   }
 
-  mgos_provision_wifi_disable_net_cb();
+  mgos_provision_wifi_save_results();
 
   if( mgos_sys_config_get_provision_wifi_fail_reboot() ){
+    mgos_provision_wifi_notify_result( false );
     mgos_system_restart();
     return; // return to prevent attempting to reconnect sta as reboot will do that anyways
   }
@@ -110,20 +277,38 @@ static void mgos_provision_wifi_connection_failed(void){
     mgos_wifi_disconnect();
     LOG(LL_INFO, ("%s", "Provision WiFi attempting previous STA connection!" ) );
 
+    // Reconnect phase is closed by energy net handler once IP is acquired from previous STA
+    mgos_provision_wifi_energy_begin();
+    mgos_event_add_group_handler(MGOS_EVENT_GRP_NET, mgos_provision_wifi_energy_reconnect_net_cb, NULL);
+
     // AP will go down for a few seconds, while reinit wifi, but should be transparent to user
     mgos_wifi_setup((struct mgos_config_wifi *) mgos_sys_config_get_wifi());
+  } else if( s_provision_wifi_coexist.moved ){
+    // AP channel is only moved at runtime, wifi.ap is never changed
+    LOG(LL_INFO, ("Provision WiFi restoring AP channel %d", s_provision_wifi_coexist.prev_channel ) );
+    mgos_wifi_setup_ap( mgos_sys_config_get_wifi_ap() );
   }
 
+  mgos_provision_wifi_notify_result( false );
+
 }
 
 static void mgos_provision_wifi_connection_success(void){
 
-  if( mgos_sys_config_get_provision_wifi_success_copy() ){
-    mgos_provision_wifi_copy_sta_values();
+  // Only one result per test (CONNECTED and IP_ACQUIRED can both end a test)
+  if( ! b_provision_wifi_testing ){
+    LOG(LL_DEBUG, ("%s", "Provision WiFi STA Connection Success ignored, test not running" ) );
+    return;
   }
 
+  // Clear before anything else, so events triggered below (disconnect) are ignored
+  mgos_provision_wifi_clear_values();
   mgos_provision_wifi_disable_net_cb();
 
+  if( mgos_sys_config_get_provision_wifi_success_copy() ){
+    mgos_provision_wifi_copy_sta_cfg();
+  }
+
   if( mgos_sys_config_get_provision_wifi_success_disconnect() ){
     LOG( LL_INFO, ("%s", "Provision WiFi Connection Success, Disconnecting...") );
     bool result = mgos_provision_wifi_disconnect_sta();
@@ -134,25 +319,28 @@ static void mgos_provision_wifi_connection_success(void){
     }
   }
 
-  mgos_provision_wifi_clear_values();
-
   mgos_provision_wifi_set_last_test( true ); // Must be ran before clearing values (to set SSID)
 
-  // If config set to disable AP on success, set to false before disabling boot test (which calls save_cfg already, to prevent calling multiple saves)
   if( mgos_sys_config_get_provision_wifi_success_disable_ap() ){
     mgos_sys_config_set_wifi_ap_enable( false );
   }
 
-  // Disable testing credentials on boot (calls save_cfg) -- must be after setting AP disabled
-  mgos_provision_wifi_disable_boot_test();
+  // Disable testing credentials on boot
+  mgos_sys_config_set_provision_wifi_boot_enable( false );
 
   if( mgos_sys_config_get_provision_wifi_success_clear() ){
-    mgos_provision_wifi_clear_sta_values();
+    mgos_provision_wifi_clear_sta_cfg();
   }
 
+  mgos_provision_wifi_save_results();
+
   if( mgos_sys_config_get_provision_wifi_success_reboot() ){
+    mgos_provision_wifi_notify_result( true );
     mgos_system_restart();
+    return;
   }
+
+  mgos_provision_wifi_notify_result( true );
 }
 
 static void mgos_provision_wifi_sta_connect_timeout_timer_cb(void *arg) {
@@ -167,6 +355,281 @@ static void mgos_provision_wifi_run_test_timer_cb(void *arg) {
   (void) arg;
 }
 
+static void mgos_provision_wifi_quality_reset(void){
+  memset(&s_provision_wifi_quality, 0, sizeof(s_provision_wifi_quality));
+  s_provision_wifi_quality.rtt = -1;
+  s_quality_rssi_total = 0;
+  s_quality_ticks = 0;
+}
+
+static void mgos_provision_wifi_quality_stop(void){
+  mgos_clear_timer(s_provision_wifi_quality_timer_id);
+  s_provision_wifi_quality_timer_id = MGOS_INVALID_TIMER_ID;
+
+  if( s_quality_nc != NULL ){
+    s_quality_nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+    s_quality_nc = NULL;
+  }
+}
+
+static void mgos_provision_wifi_quality_probe_handler(struct mg_connection *nc, int ev, void *ev_data, void *user_data) {
+  if( nc != s_quality_nc ){
+    return;
+  }
+
+  switch (ev) {
+    case MG_EV_CONNECT: {
+      int status = *((int *) ev_data);
+      // Connection refused still means gateway responded (RST), which is a valid round trip
+      if( status == 0 || status == ECONNREFUSED ){
+        s_provision_wifi_quality.rtt = (int) ((mgos_uptime() - s_quality_start) * 1000);
+        LOG(LL_INFO, ("Provision WiFi Quality gateway round trip %d ms", s_provision_wifi_quality.rtt));
+      } else {
+        LOG(LL_ERROR, ("Provision WiFi Quality gateway probe failed, status %d", status));
+      }
+      nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+      s_quality_nc = NULL;
+      break;
+    }
+    case MG_EV_CLOSE:
+      s_quality_nc = NULL;
+      break;
+  }
+
+  (void) user_data;
+}
+
+static bool mgos_provision_wifi_quality_start_probe(void){
+  struct mgos_net_ip_info ip_info;
+  char gw[16];
+  char addr[32];
+
+  memset(&ip_info, 0, sizeof(ip_info));
+
+  if( ! mgos_net_get_ip_info(MGOS_NET_IF_TYPE_WIFI, MGOS_NET_IF_WIFI_STA, &ip_info) || ip_info.gw.sin_addr.s_addr == 0 ){
+    LOG(LL_ERROR, ("%s", "Provision WiFi Quality unable to get gateway address"));
+    return false;
+  }
+
+  mgos_net_ip_to_str(&ip_info.gw, gw);
+  snprintf(addr, sizeof(addr), "tcp://%s:%d", gw, mgos_sys_config_get_provision_wifi_quality_port());
+
+  LOG(LL_INFO, ("Provision WiFi Quality probing gateway %s", addr));
+  s_quality_nc = mg_connect(mgos_get_mgr(), addr, mgos_provision_wifi_quality_probe_handler, NULL);
+
+  return s_quality_nc != NULL;
+}
+
+static void mgos_provision_wifi_quality_finish(void){
+  int min_rssi = mgos_sys_config_get_provision_wifi_quality_min_rssi();
+  int max_rtt = mgos_sys_config_get_provision_wifi_quality_max_rtt();
+
+  mgos_provision_wifi_quality_stop();
+
+  if( s_provision_wifi_quality.samples > 0 ){
+    s_provision_wifi_quality.rssi = s_quality_rssi_total / s_provision_wifi_quality.samples;
+  }
+
+  // No RSSI samples means link quality is unknown, which is never treated as passing
+  s_provision_wifi_quality.weak = ( s_provision_wifi_quality.samples == 0 ) || ( s_provision_wifi_quality.rssi < min_rssi ) || ( max_rtt > 0 && ( s_provision_wifi_quality.rtt < 0 || s_provision_wifi_quality.rtt > max_rtt ) );
+
+  LOG(LL_INFO, ("Provision WiFi Quality RSSI avg %d dBm (min %d dBm, %d samples), round trip %d ms, weak %d", s_provision_wifi_quality.rssi, s_provision_wifi_quality.rssi_min, s_provision_wifi_quality.samples, s_provision_wifi_quality.rtt, s_provision_wifi_quality.weak));
+
+  if( s_provision_wifi_quality.weak && mgos_sys_config_get_provision_wifi_quality_reject() ){
+    LOG(LL_ERROR, ("%s", "Provision WiFi Quality link is weak, rejecting credentials"));
+    mgos_provision_wifi_connection_failed();
+  } else {
+    mgos_provision_wifi_connection_success();
+  }
+}
+
+static void mgos_provision_wifi_quality_timer_cb(void *arg) {
+  int rssi = mgos_wifi_sta_get_rssi();
+  int max_rtt = mgos_sys_config_get_provision_wifi_quality_max_rtt();
+
+  // 0 is returned when RSSI is not available
+  if( rssi != 0 ){
+    if( s_provision_wifi_quality.samples == 0 || rssi < s_provision_wifi_quality.rssi_min ){
+      s_provision_wifi_quality.rssi_min = rssi;
+    }
+    s_quality_rssi_total += rssi;
+    s_provision_wifi_quality.samples++;
+  }
+
+  // Count timer ticks (not valid samples) so stage still ends when RSSI is never available
+  bool sampling_done = ++s_quality_ticks >= mgos_sys_config_get_provision_wifi_quality_samples();
+  // Probe is done when handled, or max_rtt has passed (anything longer is weak anyways)
+  bool probe_done = s_quality_nc == NULL || ( mgos_uptime() - s_quality_start ) * 1000 > max_rtt;
+
+  if( sampling_done && probe_done ){
+    mgos_provision_wifi_quality_finish();
+  }
+
+  (void) arg;
+}
+
+/*
+ * Start link quality stage, sampling RSSI every provision.wifi.quality.interval ms and
+ * measuring round trip to gateway.  Connect timeout still applies while this is running.
+ */
+static void mgos_provision_wifi_quality_start(void){
+  int interval = mgos_sys_config_get_provision_wifi_quality_interval();
+
+  LOG(LL_INFO, ("%s", "Provision WiFi Quality stage started"));
+  mgos_provision_wifi_quality_reset();
+  s_quality_start = mgos_uptime();
+
+  if( mgos_sys_config_get_provision_wifi_quality_max_rtt() > 0 ){
+    mgos_provision_wifi_quality_start_probe();
+  }
+
+  s_provision_wifi_quality_timer_id = mgos_set_timer(interval > 0 ? interval : 1, MGOS_TIMER_REPEAT, mgos_provision_wifi_quality_timer_cb, NULL);
+}
+
+static void mgos_provision_wifi_coexist_ap_cb(int ev, void *evd, void *arg) {
+  // Only a single pending disconnect is tracked, which covers the usual single portal client
+  if( ev == MGOS_WIFI_EV_AP_STA_DISCONNECTED ){
+    s_provision_wifi_coexist.disconnects++;
+    if( s_coexist_disconnected_at == 0 ){
+      s_coexist_disconnected_at = mgos_uptime();
+    }
+    LOG(LL_INFO, ("Provision WiFi Coexist portal client DISCONNECTED (%d total)", s_provision_wifi_coexist.disconnects));
+  } else if( ev == MGOS_WIFI_EV_AP_STA_CONNECTED && s_coexist_disconnected_at > 0 ){
+    int ms = (int) ((mgos_uptime() - s_coexist_disconnected_at) * 1000);
+    s_provision_wifi_coexist.reassoc_ms += ms;
+    s_coexist_disconnected_at = 0;
+    LOG(LL_INFO, ("Provision WiFi Coexist portal client re-associated after %d ms", ms));
+  }
+
+  (void) evd;
+  (void) arg;
+}
+
+static void mgos_provision_wifi_coexist_reset(void){
+  memset(&s_provision_wifi_coexist, 0, sizeof(s_provision_wifi_coexist));
+  s_coexist_disconnected_at = 0;
+}
+
+static bool mgos_provision_wifi_coexist_enabled(void){
+  // Nothing to keep connected when AP is disabled
+  return mgos_sys_config_get_provision_wifi_coexist_enable() && mgos_sys_config_get_wifi_ap_enable();
+}
+
+static void mgos_provision_wifi_coexist_stop(void){
+  mgos_clear_timer(s_provision_wifi_notice_timer_id);
+  s_provision_wifi_notice_timer_id = MGOS_INVALID_TIMER_ID;
+  mgos_clear_timer(s_provision_wifi_scan_timer_id);
+  s_provision_wifi_scan_timer_id = MGOS_INVALID_TIMER_ID;
+  mgos_event_remove_handler(MGOS_WIFI_EV_AP_STA_CONNECTED, mgos_provision_wifi_coexist_ap_cb, NULL);
+  mgos_event_remove_handler(MGOS_WIFI_EV_AP_STA_DISCONNECTED, mgos_provision_wifi_coexist_ap_cb, NULL);
+}
+
+/*
+ * Move AP to target network channel (must be called after existing STA is disconnected, as a connected STA forces AP channel)
+ */
+static void mgos_provision_wifi_coexist_move_ap(void){
+  if( s_provision_wifi_coexist.target_channel <= 0 || s_provision_wifi_coexist.target_channel == s_provision_wifi_coexist.prev_channel ){
+    return;
+  }
+
+  LOG(LL_INFO, ("Provision WiFi Coexist moving AP from channel %d to %d", s_provision_wifi_coexist.prev_channel, s_provision_wifi_coexist.target_channel));
+
+  // Use a copy so the test channel is never saved to wifi.ap.channel
+  struct mgos_config_wifi_ap ap_cfg = *mgos_sys_config_get_wifi_ap();
+  ap_cfg.channel = s_provision_wifi_coexist.target_channel;
+
+  if( mgos_wifi_setup_ap( &ap_cfg ) ){
+    s_provision_wifi_coexist.moved = true;
+  } else {
+    LOG(LL_ERROR, ("%s", "Provision WiFi Coexist unable to move AP, restoring channel"));
+    mgos_wifi_setup_ap( mgos_sys_config_get_wifi_ap() );
+  }
+}
+
+static void mgos_provision_wifi_notice_timer_cb(void *arg) {
+  s_provision_wifi_notice_timer_id = MGOS_INVALID_TIMER_ID;
+  mgos_provision_wifi_start_test();
+  (void) arg;
+}
+
+static void mgos_provision_wifi_coexist_scan_cb(int num_res, struct mgos_wifi_scan_result *res, void *arg) {
+  // Test may have been ended, or scan timeout already started the test, while scan was running
+  if( ! b_provision_wifi_testing || s_provision_wifi_scan_timer_id == MGOS_INVALID_TIMER_ID ){
+    return;
+  }
+
+  mgos_clear_timer(s_provision_wifi_scan_timer_id);
+  s_provision_wifi_scan_timer_id = MGOS_INVALID_TIMER_ID;
+
+  // Notice and disconnecting existing STA are charged as disconnect phase
+  mgos_provision_wifi_energy_end(MGOS_PROVISION_WIFI_PHASE_SCAN);
+  mgos_provision_wifi_energy_begin();
+
+  const char *ssid = mgos_sys_config_get_provision_wifi_sta_ssid();
+  int best_rssi = 0;
+
+  for( int i = 0; i < num_res; i++ ){
+    if( ssid != NULL && strcmp(res[i].ssid, ssid) == 0 && ( s_provision_wifi_coexist.target_channel == 0 || res[i].rssi > best_rssi ) ){
+      s_provision_wifi_coexist.target_channel = res[i].channel;
+      best_rssi = res[i].rssi;
+    }
+  }
+
+  if( s_provision_wifi_coexist.target_channel == 0 ){
+    LOG(LL_ERROR, ("Provision WiFi Coexist %s not found in scan (%d results), AP channel not changed", ssid ? ssid : "", num_res));
+    mgos_provision_wifi_start_test();
+    return;
+  }
+
+  if( s_provision_wifi_coexist.target_channel == s_provision_wifi_coexist.prev_channel ){
+    LOG(LL_INFO, ("Provision WiFi Coexist %s already on AP channel %d", ssid, s_provision_wifi_coexist.target_channel));
+    mgos_provision_wifi_start_test();
+    return;
+  }
+
+  int notice = mgos_sys_config_get_provision_wifi_coexist_notice();
+
+  LOG(LL_INFO, ("Provision WiFi Coexist %s on channel %d, moving AP in %d ms", ssid, s_provision_wifi_coexist.target_channel, notice));
+
+  if( s_provision_wifi_notice_cb != NULL ){
+    s_provision_wifi_notice_cb( s_provision_wifi_coexist.target_channel, notice, s_provision_wifi_notice_cb_userdata );
+  }
+
+  if( notice > 0 ){
+    s_provision_wifi_notice_timer_id = mgos_set_timer(notice, 0, mgos_provision_wifi_notice_timer_cb, NULL);
+  } else {
+    mgos_provision_wifi_start_test();
+  }
+
+  (void) arg;
+}
+
+static void mgos_provision_wifi_scan_timeout_timer_cb(void *arg) {
+  s_provision_wifi_scan_timer_id = MGOS_INVALID_TIMER_ID;
+  LOG(LL_ERROR, ("%s", "Provision WiFi Coexist scan timeout, AP channel not changed"));
+  mgos_provision_wifi_energy_end(MGOS_PROVISION_WIFI_PHASE_SCAN);
+  mgos_provision_wifi_energy_begin();
+  mgos_provision_wifi_start_test();
+  (void) arg;
+}
+
+/*
+ * Start coexistence mode, scanning for target network channel before starting STA test.  When the scan
+ * does not finish within provision.wifi.coexist.scan_timeout the test is started without moving AP.
+ */
+static void mgos_provision_wifi_coexist_start(void){
+  int scan_timeout = mgos_sys_config_get_provision_wifi_coexist_scan_timeout();
+
+  s_provision_wifi_coexist.prev_channel = mgos_sys_config_get_wifi_ap_channel();
+  s_provision_wifi_scan_timer_id = mgos_set_timer((scan_timeout > 0 ? scan_timeout : 1) * 1000, 0, mgos_provision_wifi_scan_timeout_timer_cb, NULL);
+
+  mgos_event_add_handler(MGOS_WIFI_EV_AP_STA_CONNECTED, mgos_provision_wifi_coexist_ap_cb, NULL);
+  mgos_event_add_handler(MGOS_WIFI_EV_AP_STA_DISCONNECTED, mgos_provision_wifi_coexist_ap_cb, NULL);
+
+  LOG(LL_INFO, ("%s", "Provision WiFi Coexist scanning for target network channel"));
+  mgos_wifi_scan(mgos_provision_wifi_coexist_scan_cb, NULL);
+}
+
 static void mgos_provision_wifi_net_cb(int ev, void *evd, void *arg) {
   // We only want to process events when we are testing
   if( ! b_provision_wifi_testing ){
@@ -182,6 +645,9 @@ static void mgos_provision_wifi_net_cb(int ev, void *evd, void *arg) {
 
       LOG(LL_INFO, ("Provision WiFi STA DISCONNECTED, Attempts %d, Max Attempt %d", s_provision_wifi_con_attempts, i_provision_wifi_total_attempts ));
 
+      // Link dropped while checking quality, restart quality stage after reconnect
+      mgos_provision_wifi_quality_stop();
+
       if ( s_provision_wifi_con_attempts >= i_provision_wifi_total_attempts ) {
         LOG(LL_ERROR, ("Provision WiFi STA FAILED after %d total attempts (Max of %d)", s_provision_wifi_con_attempts, i_provision_wifi_total_attempts ));
         mgos_provision_wifi_connection_failed();
@@ -216,7 +682,13 @@ static void mgos_provision_wifi_net_cb(int ev, void *evd, void *arg) {
 
       if( connected_ssid != NULL && ( strcmp(connected_ssid, testing_ssid) == 0 ) ){
         LOG(LL_INFO, ("Provision WiFi STA Connected after %d attempts", s_provision_wifi_con_attempts));
-        mgos_provision_wifi_connection_success();
+
+        if( ! mgos_sys_config_get_provision_wifi_quality_enable() ){
+          mgos_provision_wifi_connection_success();
+        } else if( ev == MGOS_NET_EV_IP_ACQUIRED && s_provision_wifi_quality_timer_id == MGOS_INVALID_TIMER_ID ){
+          // Quality stage needs IP to reach gateway
+          mgos_provision_wifi_quality_start();
+        }
       } else {
         LOG(LL_INFO, ("Provision WiFi STA Connected to %s", connected_ssid ));        
       }
@@ -244,7 +716,10 @@ bool mgos_provision_wifi_is_test_running(void){
   return b_provision_wifi_testing;
 }
 
-bool mgos_provision_wifi_copy_sta_values(void){
+/*
+ * Copy test STA values to wifi.sta without saving config
+ */
+static bool mgos_provision_wifi_copy_sta_cfg(void){
 
   LOG(LL_INFO, ( "Provision WiFi Copy Test STA Values" ) );
 
@@ -274,6 +749,15 @@ bool mgos_provision_wifi_copy_sta_values(void){
   mgos_sys_config_set_wifi_sta_ssid( cfg->ssid );
   mgos_sys_config_set_wifi_sta_user( cfg->user );
 
+  return true;
+}
+
+bool mgos_provision_wifi_copy_sta_values(void){
+
+  if( ! mgos_provision_wifi_copy_sta_cfg() ){
+    return false;
+  }
+
   char *err = NULL;
   if( ! save_cfg(&mgos_sys_config, &err) ){
     LOG(LL_ERROR, ("Provision WiFi Copy STA Values, Save Config Error: %s", err) );
@@ -284,7 +768,10 @@ bool mgos_provision_wifi_copy_sta_values(void){
   return true;
 }
 
-bool mgos_provision_wifi_clear_sta_values(void){
+/*
+ * Clear test STA values from provision.wifi.sta without saving config
+ */
+static void mgos_provision_wifi_clear_sta_cfg(void){
 
   LOG(LL_INFO, ( "Provision WiFi Clear Test STA Values" ) );
   // TODO: Copy cfg to config instead of having to set each individual value
@@ -302,6 +789,11 @@ bool mgos_provision_wifi_clear_sta_values(void){
   mgos_sys_config_set_provision_wifi_sta_pass( "" );
   mgos_sys_config_set_provision_wifi_sta_ssid( "" );
   mgos_sys_config_set_provision_wifi_sta_user( "" );
+}
+
+bool mgos_provision_wifi_clear_sta_values(void){
+
+  mgos_provision_wifi_clear_sta_cfg();
 
   char *err = NULL;
   if( ! save_cfg(&mgos_sys_config, &err) ){
@@ -331,7 +823,7 @@ bool mgos_provision_wifi_disable_boot_test(void){
 bool mgos_provision_wifi_enable_boot_test(void){
   // Disable Provision WiFi in configuration
   LOG(LL_INFO, ("Enabling Provision WiFi Testing on Boot"));
-  mgos_sys_config_set_provision_wifi_boot_enable(false);
+  mgos_sys_config_set_provision_wifi_boot_enable(true);
 
   char *err = NULL;
   if( ! save_cfg(&mgos_sys_config, &err) ){
@@ -389,8 +881,9 @@ bool mgos_provision_wifi_connect_sta(void) {
     
     int connect_timeout = mgos_sys_config_get_provision_wifi_timeout();
 
-    // Add timer if not already set (but should be already set by mgos_provision_wifi_run_test() )
-    if (connect_timeout > 0 && s_provision_wifi_timer_id == MGOS_INVALID_TIMER_ID) {
+    // Add timer if not already set (but should be already set by mgos_provision_wifi_run_test() ), only while testing,
+    // otherwise a manual connect would later trigger a failed result for a test that is not running
+    if (b_provision_wifi_testing && connect_timeout > 0 && s_provision_wifi_timer_id == MGOS_INVALID_TIMER_ID) {
       s_provision_wifi_timer_id = mgos_set_timer(connect_timeout * 1000, 0, mgos_provision_wifi_sta_connect_timeout_timer_cb, NULL);
     }
   }
@@ -413,6 +906,161 @@ const char *mgos_provision_wifi_get_last_test_ssid(void){
   return mgos_sys_config_get_provision_wifi_results_ssid();
 }
 
+const struct mgos_provision_wifi_energy *mgos_provision_wifi_get_last_test_energy(void){
+  return &s_provision_wifi_energy;
+}
+
+int mgos_provision_wifi_get_last_test_radio_ms(void){
+  return mgos_sys_config_get_provision_wifi_results_radio_ms();
+}
+
+int mgos_provision_wifi_get_last_test_charge(void){
+  return mgos_sys_config_get_provision_wifi_results_charge();
+}
+
+int mgos_provision_wifi_get_last_test_reconnect_ms(void){
+  return mgos_sys_config_get_provision_wifi_results_reconnect_ms();
+}
+
+const struct mgos_provision_wifi_quality *mgos_provision_wifi_get_last_test_quality(void){
+  return &s_provision_wifi_quality;
+}
+
+int mgos_provision_wifi_get_last_test_rssi(void){
+  return mgos_sys_config_get_provision_wifi_results_rssi();
+}
+
+int mgos_provision_wifi_get_last_test_rtt(void){
+  return mgos_sys_config_get_provision_wifi_results_rtt();
+}
+
+const char *mgos_provision_wifi_get_last_test_reason(void){
+  return mgos_sys_config_get_provision_wifi_results_reason();
+}
+
+bool mgos_provision_wifi_get_last_test_weak(void){
+  return mgos_sys_config_get_provision_wifi_results_weak();
+}
+
+const struct mgos_provision_wifi_coexist *mgos_provision_wifi_get_last_test_coexist(void){
+  return &s_provision_wifi_coexist;
+}
+
+int mgos_provision_wifi_get_last_test_ap_disconnects(void){
+  return mgos_sys_config_get_provision_wifi_results_ap_disconnects();
+}
+
+int mgos_provision_wifi_get_last_test_reassoc_ms(void){
+  return mgos_sys_config_get_provision_wifi_results_reassoc_ms();
+}
+
+void mgos_provision_wifi_set_notice_cb(mgos_provision_wifi_notice_cb_t cb, void *userdata){
+  s_provision_wifi_notice_cb = cb;
+  s_provision_wifi_notice_cb_userdata = userdata;
+}
+
+static void mgos_provision_wifi_deferred_test_cb(void *arg) {
+  // Another test was ran after this was deferred (energy is reset for every test)
+  if( ! s_provision_wifi_energy.deferred ){
+    LOG(LL_DEBUG, ("%s", "Provision WiFi deferred test ignored, another test was already ran"));
+    return;
+  }
+
+  LOG(LL_INFO, ("%s", "Provision WiFi running deferred test"));
+  // Budget was checked when existing STA disconnected, which wifi lib is usually already reconnecting by now
+  b_energy_deferred_run = true;
+  mgos_provision_wifi_run_test();
+  b_energy_deferred_run = false;
+  (void) arg;
+}
+
+/*
+ * Estimate only gets lower when the existing STA disconnects (no settle or reconnect needed), so that is
+ * when a deferred test is checked again.
+ */
+static void mgos_provision_wifi_energy_defer_net_cb(int ev, void *evd, void *arg) {
+  int budget = mgos_sys_config_get_provision_wifi_energy_budget();
+
+  if( ev != MGOS_NET_EV_DISCONNECTED || b_provision_wifi_testing ){
+    return;
+  }
+
+  if( budget > 0 && mgos_provision_wifi_energy_estimate( false ) > budget ){
+    return;
+  }
+
+  mgos_event_remove_group_handler(MGOS_EVENT_GRP_NET, mgos_provision_wifi_energy_defer_net_cb, NULL);
+  // Start test outside of net event handlers
+  mgos_invoke_cb(mgos_provision_wifi_deferred_test_cb, NULL, false);
+
+  (void) evd;
+  (void) arg;
+}
+
+/*
+ * Test was not started because it would exceed provision.wifi.energy.budget.  Credentials were never
+ * tried, so fail.clear, fail.reboot and reconnect are skipped, and the reason is set in results.
+ *
+ * `deferred_run` is true when this is the deferred test being ran (see mgos_provision_wifi_energy_defer_net_cb())
+ */
+static void mgos_provision_wifi_budget_exceeded(bool defer, bool deferred_run){
+  const char *reason = defer ? "budget_defer" : "budget_abort";
+  const char *results_reason = mgos_sys_config_get_provision_wifi_results_reason();
+  const char *results_ssid = mgos_sys_config_get_provision_wifi_results_ssid();
+  const char *ssid = mgos_sys_config_get_provision_wifi_sta_ssid();
+  // Deferred test deferred again (config changed since) would save and report the exact same results
+  bool same_result = defer && deferred_run && results_reason != NULL && strcmp(results_reason, reason) == 0 &&
+                     strcmp(results_ssid ? results_ssid : "", ssid ? ssid : "") == 0;
+
+  mgos_provision_wifi_clear_values();
+
+  if( defer ){
+    // Boot test is left enabled, and test is ran once estimate fits budget
+    s_provision_wifi_energy.deferred = true;
+    mgos_event_add_group_handler(MGOS_EVENT_GRP_NET, mgos_provision_wifi_energy_defer_net_cb, NULL);
+  } else {
+    s_provision_wifi_energy.aborted = true;
+    mgos_sys_config_set_provision_wifi_boot_enable( false );
+  }
+
+  if( same_result ){
+    LOG(LL_INFO, ("%s", "Provision WiFi deferred test still exceeds budget, results not changed"));
+    return;
+  }
+
+  mgos_provision_wifi_store_results( false, reason );
+  mgos_provision_wifi_save_results();
+
+  mgos_provision_wifi_notify_result( false );
+}
+
+/*
+ * Check worst case charge of test against provision.wifi.energy.budget
+ *
+ * Returns false when test should not be started (budget exceeded)
+ */
+static bool mgos_provision_wifi_energy_check_budget(void){
+  int budget = mgos_sys_config_get_provision_wifi_energy_budget();
+  // Only for this test, as callback can start another one
+  bool deferred_run = b_energy_deferred_run;
+  b_energy_deferred_run = false;
+
+  // Deferred test uses same estimate (existing STA disconnected) that was checked before running it
+  s_provision_wifi_energy.estimate = mgos_provision_wifi_energy_estimate( ! deferred_run && mgos_wifi_get_status() != MGOS_WIFI_DISCONNECTED );
+
+  if( budget <= 0 || s_provision_wifi_energy.estimate <= budget ){
+    return true;
+  }
+
+  const char *action = mgos_sys_config_get_provision_wifi_energy_action();
+  bool defer = action != NULL && strcmp(action, "defer") == 0;
+
+  LOG(LL_ERROR, ("Provision WiFi test %s, estimate %d uAh exceeds budget of %d uAh", defer ? "DEFERRED" : "ABORTED", s_provision_wifi_energy.estimate, budget));
+  mgos_provision_wifi_budget_exceeded( defer, deferred_run );
+
+  return false;
+}
+
 bool mgos_provision_wifi_disconnect_connected_sta(void){
   
   enum mgos_wifi_status sta_status = mgos_wifi_get_status();
@@ -458,15 +1106,54 @@ bool mgos_provision_wifi_disconnect_connected_sta(void){
  * 
  */
 void mgos_provision_wifi_run_test(void){
-  bool result = false;
+  if( b_provision_wifi_testing ){
+    LOG(LL_ERROR, ("%s", "Provision WiFi Run Test Error - Test already running" ) );
+    return;
+  }
 
   b_provision_wifi_testing = true;
-  s_provision_wifi_lock = mgos_rlock_create();
+
+  // Lock is only created once, and reused for every test
+  if( s_provision_wifi_lock == NULL ){
+    s_provision_wifi_lock = mgos_rlock_create();
+  }
   // mgos_wifi_add_on_change_cb((struct mgos_wifi_add_on_change_cb *) mgos_provision_wifi_net_cb_test, NULL);
 
+  mgos_provision_wifi_energy_reset();
+  mgos_provision_wifi_quality_reset();
+  mgos_provision_wifi_coexist_reset();
+  if( ! mgos_provision_wifi_energy_check_budget() ){
+    return;
+  }
+
+  // Scan phase (coexist) is ended once scan is done, disconnect phase (includes notice) in mgos_provision_wifi_start_test()
+  mgos_provision_wifi_energy_begin();
+
+  if( mgos_provision_wifi_coexist_enabled() ){
+    mgos_provision_wifi_coexist_start();
+  } else {
+    mgos_provision_wifi_start_test();
+  }
+}
+
+/**
+ * @brief Disconnect existing STA and start connecting to test STA
+ *
+ */
+static void mgos_provision_wifi_start_test(void){
+  bool result = false;
   const struct mgos_config_provision_wifi_sta *cfg = mgos_sys_config_get_provision_wifi_sta();
-  
+
   mgos_provision_wifi_disconnect_connected_sta();
+
+  if( mgos_provision_wifi_coexist_enabled() ){
+    mgos_provision_wifi_coexist_move_ap();
+  }
+
+  mgos_provision_wifi_energy_end(MGOS_PROVISION_WIFI_PHASE_DISCONNECT);
+
+  // Connect phase ends when test results are set (success or failure)
+  mgos_provision_wifi_energy_begin();
   // mgos_provision_wifi_setup_sta() calls wifi disconnect before dev setup
   result = mgos_provision_wifi_setup_sta( cfg );
   
@@ -522,6 +1209,12 @@ void mgos_provision_wifi_test_ssid_pass(const char *ssid, const char *pass, mgos
     return;
   }
 
+  // Changing SSID while a test is running would make the running test compare against the wrong SSID
+  if( b_provision_wifi_testing ){
+    LOG(LL_ERROR, ("%s", "Provision WiFi Test SSID PASS Error - Test already running" ) );
+    return;
+  }
+
   mgos_sys_config_set_provision_wifi_sta_ssid( ssid );
   mgos_sys_config_set_provision_wifi_sta_pass( pass );
 
@@ -533,6 +1226,11 @@ void mgos_provision_wifi_test_ssid_pass(const char *ssid, const char *pass, mgos
 
 bool mgos_provision_wifi_init(void) {
 
+  // Created here as connect/disconnect/setup STA can be called before any test is ran
+  if( s_provision_wifi_lock == NULL ){
+    s_provision_wifi_lock = mgos_rlock_create();
+  }
+
   // Check if config is set to true to test WiFi STA on device boot
   if( mgos_sys_config_get_provision_wifi_boot_enable() ){
 
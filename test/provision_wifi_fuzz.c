@@ -0,0 +1,704 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host fuzz / throughput harness for src/mgos_provision_wifi.c
+ *
+ * Feeds random sequences of net events, AP events, timer expirations, scan and probe results and public API
+ * calls to the library (linked against the stubs in test/stubs), checking after every step that:
+ *
+ *  - every started test gets exactly one result (callback), and never a result without a test
+ *  - config is saved at most once per result and once per API call that saves
+ *  - nothing (save, wifi setup, AP restore) is done for a result after its callback was called
+ *  - a test started from the callback keeps its own test SSID
+ *  - a failed test never leaves the test STA associated
+ *  - no timers, connections, scans or event handlers are left behind once everything is done
+ *
+ * Built as a standalone binary (random inputs from a seed, or replaying input files), or as a libFuzzer
+ * target when PROVISION_WIFI_LIBFUZZER is defined.  See test/CMakeLists.txt
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mgos.h"
+#include "mgos_provision_wifi.h"
+#include "mgos_stubs.h"
+#include "mgos_wifi.h"
+
+bool mgos_provision_wifi_init(void);
+
+#define FUZZ_MAX_STEPS 10000
+#define FUZZ_MAX_RETRIES 3
+#define FUZZ_MAX_BOOT_TIMERS 32
+
+static const char *s_ssids[] = {"TestNet", "OtherNet", ""};
+
+struct fuzz_input {
+  const uint8_t *data;
+  size_t size;
+  size_t pos;
+};
+
+struct fuzz_state {
+  int starts;     // Tests started (seen from harness side)
+  int verdicts;   // Test callback calls
+  int retries;    // Tests started from test callback
+  bool retry;     // Start a new test from test callback
+  bool deferred_run;  // Deferred test is being ran, until its result
+  int allowed_saves;
+  struct stub_stats after_cb;  // Stats right after last callback (and retry) returned
+  bool cb_called;
+  const char *retry_ssid;
+  int retry_verdicts;
+  mgos_timer_id boot_timers[FUZZ_MAX_BOOT_TIMERS];
+  int boot_timer_count;
+};
+
+static struct fuzz_state s_fs;
+static unsigned long s_step;        // Step of current input
+static unsigned long s_total_steps;
+static unsigned long s_inputs;
+static const struct fuzz_input *s_input = NULL;
+
+static void fuzz_fail(const char *fmt, ...) {
+  va_list ap;
+  fflush(stdout);
+  va_start(ap, fmt);
+  fprintf(stderr, "INVARIANT FAILED (input %lu, step %lu): ", s_inputs, s_step);
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+
+#ifndef PROVISION_WIFI_LIBFUZZER
+  // libFuzzer saves the input itself
+  FILE *fp = fopen("provision_wifi_fuzz_failure.bin", "wb");
+  if (fp != NULL && s_input != NULL) {
+    fwrite(s_input->data, 1, s_input->size, fp);
+    fprintf(stderr, "Input saved to provision_wifi_fuzz_failure.bin (replay with -v)\n");
+  }
+  if (fp != NULL) fclose(fp);
+#endif
+
+  abort();
+}
+
+static uint8_t fuzz_byte(struct fuzz_input *in) {
+  return in->pos < in->size ? in->data[in->pos++] : 0;
+}
+
+/* Test callback */
+
+static void fuzz_test_cb(bool success, const char *ssid, void *userdata) {
+  const struct stub_stats *st = stub_get_stats();
+
+  s_fs.verdicts++;
+  if (mgos_provision_wifi_is_test_running()) {
+    fuzz_fail("test callback called while test still running");
+  }
+  if (ssid == NULL) {
+    fuzz_fail("test callback called without SSID");
+  }
+  s_fs.allowed_saves++;  // Single results save, done before this callback
+
+  // Deferred test is ran once estimate fits budget, config never changes in between here, so it must not be
+  // deferred again (each time would be another save and callback)
+  if (s_fs.deferred_run && strcmp(mgos_provision_wifi_get_last_test_reason(), "budget_defer") == 0) {
+    fuzz_fail("deferred test deferred again");
+  }
+  s_fs.deferred_run = false;
+
+  // A failed test (not aborted/deferred by budget) must never leave test STA associated or connecting
+  if (!success && mgos_provision_wifi_get_last_test_reason()[0] == '\0' &&
+      mgos_wifi_get_status() != MGOS_WIFI_DISCONNECTED) {
+    fuzz_fail("test STA left associated after failed test (status %d)", mgos_wifi_get_status());
+  }
+
+  // Scan is bounded by scan timeout, which is what budget estimate charges it for
+  int scan_timeout = mgos_sys_config_get_provision_wifi_coexist_scan_timeout();
+  if (mgos_provision_wifi_get_last_test_energy()->scan_ms > (scan_timeout > 0 ? scan_timeout : 1) * 1000) {
+    fuzz_fail("scan phase of %d ms longer than scan timeout", mgos_provision_wifi_get_last_test_energy()->scan_ms);
+  }
+
+  if (s_fs.retry && s_fs.retries < FUZZ_MAX_RETRIES) {
+    s_fs.retries++;
+    s_fs.starts++;
+    s_fs.retry_ssid = s_ssids[s_fs.retries % 2];
+    s_fs.allowed_saves++;  // test_ssid_pass() saves SSID and PASS
+    mgos_provision_wifi_test_ssid_pass(s_fs.retry_ssid, "password", fuzz_test_cb, NULL);
+    s_fs.retry_verdicts = s_fs.verdicts;
+  }
+
+  s_fs.after_cb = *st;
+  s_fs.cb_called = true;
+
+  (void) success;
+  (void) userdata;
+}
+
+/* Harness ops */
+
+static bool fuzz_is_boot_timer(mgos_timer_id id) {
+  for (int i = 0; i < s_fs.boot_timer_count; i++) {
+    if (s_fs.boot_timers[i] == id) {
+      s_fs.boot_timers[i] = s_fs.boot_timers[--s_fs.boot_timer_count];
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool fuzz_fire_timer(void) {
+  bool was_running = mgos_provision_wifi_is_test_running();
+  mgos_timer_id id = stub_fire_next_timer();
+  // Boot test timer from mgos_provision_wifi_init() only starts a test when none is running
+  if (id != MGOS_INVALID_TIMER_ID && fuzz_is_boot_timer(id) && !was_running) {
+    s_fs.starts++;
+  }
+  return id != MGOS_INVALID_TIMER_ID;
+}
+
+static bool fuzz_run_invoked(void) {
+  // Only invoked callback used by library is the deferred test, ignored when another test ran since
+  bool start = stub_get_stats()->invoke_pending > 0 && !mgos_provision_wifi_is_test_running() &&
+               mgos_provision_wifi_get_last_test_energy()->deferred;
+  int verdicts = s_fs.verdicts;
+
+  if (start) s_fs.starts++;
+  s_fs.deferred_run = start;
+  bool ran = stub_run_invoked();
+  s_fs.deferred_run = false;
+
+  if (start && s_fs.verdicts == verdicts && !mgos_provision_wifi_is_test_running()) {
+    fuzz_fail("deferred test deferred again without result");
+  }
+  return ran;
+}
+
+static void fuzz_init(void) {
+  // Checked before, as a test ran from mgos_provision_wifi_init() disables boot test
+  bool boot = mgos_sys_config_get_provision_wifi_boot_enable();
+  bool delayed = mgos_sys_config_get_wifi_sta_enable() && mgos_sys_config_get_provision_wifi_boot_delay() > 0;
+  bool was_running = mgos_provision_wifi_is_test_running();
+
+  mgos_provision_wifi_init();
+
+  if (!boot) {
+    return;
+  }
+
+  // Same as mgos_provision_wifi_init(), boot test is delayed when existing STA is enabled
+  if (delayed) {
+    if (s_fs.boot_timer_count >= FUZZ_MAX_BOOT_TIMERS) {
+      fuzz_fail("too many boot timers");
+    }
+    s_fs.boot_timers[s_fs.boot_timer_count++] = stub_last_timer_id();
+  } else if (!was_running) {
+    s_fs.starts++;
+  }
+}
+
+static void fuzz_check_step(const struct stub_stats *before, int verdicts_before) {
+  const struct stub_stats *st = stub_get_stats();
+
+  if (s_fs.verdicts > s_fs.starts) {
+    fuzz_fail("%d results for %d started tests", s_fs.verdicts, s_fs.starts);
+  }
+  if (st->saves - before->saves > s_fs.allowed_saves) {
+    fuzz_fail("%d config saves, only %d expected", st->saves - before->saves, s_fs.allowed_saves);
+  }
+  if (st->rlocks_created > 1) {
+    fuzz_fail("lock created %d times", st->rlocks_created);
+  }
+  if (st->rlock_errors > 0) {
+    fuzz_fail("lock used before created, or unlocked more than locked");
+  }
+  if (stub_handler_duplicates()) {
+    fuzz_fail("event handler added more than once");
+  }
+  if (s_fs.cb_called && s_fs.verdicts > verdicts_before) {
+    // Nothing must be changed for a result once its callback was called (callback may start a new test)
+    if (st->saves != s_fs.after_cb.saves || st->wifi_setups != s_fs.after_cb.wifi_setups ||
+        st->ap_setups != s_fs.after_cb.ap_setups || st->restarts != s_fs.after_cb.restarts) {
+      fuzz_fail("config saved or wifi changed after test callback (saves %d/%d, setups %d/%d, ap %d/%d)",
+                st->saves, s_fs.after_cb.saves, st->wifi_setups, s_fs.after_cb.wifi_setups, st->ap_setups,
+                s_fs.after_cb.ap_setups);
+    }
+  }
+  if (s_fs.retry_ssid != NULL && s_fs.verdicts == s_fs.retry_verdicts && mgos_provision_wifi_is_test_running()) {
+    const char *ssid = mgos_sys_config_get_provision_wifi_sta_ssid();
+    if (ssid == NULL || strcmp(ssid, s_fs.retry_ssid) != 0) {
+      fuzz_fail("test started from callback had SSID changed to %s", ssid ? ssid : "(null)");
+    }
+  }
+}
+
+static void fuzz_op(struct fuzz_input *in) {
+  struct stub_stats before = *stub_get_stats();
+  int verdicts_before = s_fs.verdicts;
+  bool was_running = mgos_provision_wifi_is_test_running();
+  uint8_t op = fuzz_byte(in);
+  uint8_t arg = fuzz_byte(in);
+  const char *ssid = s_ssids[arg % 3];
+
+  s_fs.allowed_saves = 0;
+  s_fs.cb_called = false;
+  s_fs.retry_ssid = NULL;
+
+  LOG(LL_DEBUG, ("-- step %lu: op %d arg %d (started %d, results %d)", s_step, op % 24, arg, s_fs.starts, s_fs.verdicts));
+
+  switch (op % 24) {
+    case 0:
+      if (!was_running) s_fs.starts++;
+      mgos_provision_wifi_test(fuzz_test_cb, NULL);
+      break;
+    case 1:
+      if (!was_running) s_fs.starts++;
+      mgos_provision_wifi_run_test();
+      break;
+    case 2:
+      if (!was_running) {
+        s_fs.starts++;
+        s_fs.allowed_saves++;
+      }
+      mgos_provision_wifi_test_ssid_pass(ssid, "password", fuzz_test_cb, NULL);
+      break;
+    case 3:
+    case 4:
+      stub_net_event(MGOS_NET_EV_DISCONNECTED, NULL);
+      break;
+    case 5:
+      stub_net_event(MGOS_NET_EV_CONNECTING, NULL);
+      break;
+    case 6:
+      stub_net_event(MGOS_NET_EV_CONNECTED, s_ssids[arg % 2]);
+      break;
+    case 7:
+    case 8:
+      s_fs.allowed_saves++;  // Previous STA reconnected after failed test updates results
+      stub_net_event(MGOS_NET_EV_IP_ACQUIRED, s_ssids[arg % 2]);
+      break;
+    case 9:
+    case 10:
+    case 11:
+      fuzz_fire_timer();
+      break;
+    case 12:
+      fuzz_run_invoked();
+      break;
+    case 13:
+      stub_complete_scan(arg & 1 ? s_ssids[(arg >> 1) % 2] : NULL, 1 + (arg >> 2) % 13);
+      break;
+    case 14:
+      stub_connect_result(arg % 3 == 0 ? 0 : arg % 3 == 1 ? ECONNREFUSED : ETIMEDOUT);
+      break;
+    case 15:
+      stub_poll();
+      break;
+    case 16:
+      stub_ap_event(arg & 1 ? MGOS_WIFI_EV_AP_STA_CONNECTED : MGOS_WIFI_EV_AP_STA_DISCONNECTED);
+      break;
+    case 17:
+      if (arg & 1) {
+        mgos_provision_wifi_connect_sta();
+      } else {
+        mgos_provision_wifi_disconnect_sta();
+      }
+      break;
+    case 18:
+      s_fs.allowed_saves++;
+      mgos_provision_wifi_copy_sta_values();
+      break;
+    case 19:
+      s_fs.allowed_saves++;
+      mgos_provision_wifi_clear_sta_values();
+      break;
+    case 20:
+      s_fs.allowed_saves++;
+      if (arg & 1) {
+        mgos_provision_wifi_enable_boot_test();
+      } else {
+        mgos_provision_wifi_disable_boot_test();
+      }
+      break;
+    case 21:
+      fuzz_init();
+      break;
+    case 22:
+      stub_set_rssi(arg & 1 ? 0 : -40 - (arg >> 1) % 60);
+      break;
+    case 23: {
+      // Timers due while time passes fire in order, same as on device (stops at a result, so checks
+      // for changes after callback only cover that result)
+      double until = mgos_uptime() + (arg % 50) / 10.0;
+      while (s_fs.verdicts == verdicts_before && stub_next_timer_due() >= 0 && stub_next_timer_due() <= until) {
+        fuzz_fire_timer();
+      }
+      if (s_fs.verdicts == verdicts_before && until > mgos_uptime()) stub_advance(until - mgos_uptime());
+      break;
+    }
+  }
+
+  fuzz_check_step(&before, verdicts_before);
+}
+
+static void fuzz_configure(struct fuzz_input *in) {
+  uint8_t b;
+
+  stub_reset();
+
+  mgos_sys_config_set_provision_wifi_sta_ssid("TestNet");
+  mgos_sys_config_set_provision_wifi_sta_pass("password");
+  mgos_sys_config_set_provision_wifi_attempts(1 + fuzz_byte(in) % 5);
+  // Timeout is always set, otherwise a test without events never ends
+  mgos_sys_config_set_provision_wifi_timeout(1 + fuzz_byte(in) % 30);
+  mgos_sys_config_set_provision_wifi_boot_delay(fuzz_byte(in) % 3);
+
+  b = fuzz_byte(in);
+  mgos_sys_config_set_provision_wifi_reconnect(b & 1);
+  mgos_sys_config_set_provision_wifi_success_copy((b >> 1) & 1);
+  mgos_sys_config_set_provision_wifi_success_clear((b >> 2) & 1);
+  mgos_sys_config_set_provision_wifi_success_disconnect((b >> 3) & 1);
+  mgos_sys_config_set_provision_wifi_success_disable_ap((b >> 4) & 1);
+  mgos_sys_config_set_provision_wifi_fail_clear((b >> 5) & 1);
+  mgos_sys_config_set_wifi_sta_enable((b >> 6) & 1);
+  mgos_sys_config_set_wifi_ap_enable((b >> 7) & 1);
+
+  b = fuzz_byte(in);
+  mgos_sys_config_set_provision_wifi_quality_enable(b & 1);
+  mgos_sys_config_set_provision_wifi_quality_reject((b >> 1) & 1);
+  mgos_sys_config_set_provision_wifi_coexist_enable((b >> 2) & 1);
+  stub_set_save_fails(((b >> 3) & 3) == 3);
+  stub_set_dev_connect_fails(((b >> 5) & 3) == 3);
+  s_fs.retry = (b >> 7) & 1;
+
+  b = fuzz_byte(in);
+  mgos_sys_config_set_provision_wifi_quality_samples(b % 6);
+  mgos_sys_config_set_provision_wifi_quality_interval(50 * (b % 5));
+  mgos_sys_config_set_provision_wifi_quality_max_rtt(100 * ((b >> 3) % 4));
+
+  b = fuzz_byte(in);
+  mgos_sys_config_set_provision_wifi_coexist_notice(1000 * (b % 3));
+  mgos_sys_config_set_provision_wifi_coexist_scan_timeout(b % 4 == 0 ? 0 : 2);
+  mgos_sys_config_set_provision_wifi_energy_budget((b >> 2) % 4 == 0 ? 0 : 200 * ((b >> 2) % 8));
+  mgos_sys_config_set_provision_wifi_energy_action((b >> 5) & 1 ? "defer" : "abort");
+  mgos_sys_config_set_wifi_ap_channel(1 + (b >> 6) * 5);
+}
+
+/*
+ * Run everything left (invoked callbacks, connections, timers) until no test is running
+ */
+static void fuzz_drain(void) {
+  for (int i = 0; i < FUZZ_MAX_STEPS; i++) {
+    struct stub_stats before = *stub_get_stats();
+    int verdicts_before = s_fs.verdicts;
+    bool progress;
+
+    s_fs.allowed_saves = 0;
+    s_fs.cb_called = false;
+    s_fs.retry_ssid = NULL;
+    s_step++;
+
+    // Scans are never completed while draining, test must still end (scan timeout)
+    stub_drop_scan();
+    stub_poll();
+    progress = fuzz_run_invoked() || fuzz_fire_timer();
+    fuzz_check_step(&before, verdicts_before);
+
+    if (!progress) break;
+  }
+
+  const struct stub_stats *st = stub_get_stats();
+
+  if (mgos_provision_wifi_is_test_running()) {
+    fuzz_fail("test still running after all timers fired");
+  }
+  if (s_fs.verdicts != s_fs.starts) {
+    fuzz_fail("%d tests started, %d results", s_fs.starts, s_fs.verdicts);
+  }
+  if (st->timers_active != 0 || st->conns_open != 0 || st->scans_pending != 0 || st->invoke_pending != 0) {
+    fuzz_fail("left behind %d timers, %d connections, %d scans, %d invoked callbacks", st->timers_active,
+              st->conns_open, st->scans_pending, st->invoke_pending);
+  }
+  if (stub_handler_count(MGOS_WIFI_EV_AP_STA_CONNECTED) != 0 ||
+      stub_handler_count(MGOS_WIFI_EV_AP_STA_DISCONNECTED) != 0) {
+    fuzz_fail("AP event handlers left behind");
+  }
+  // Only energy reconnect and deferred test handlers are allowed once no test is running
+  if (stub_handler_count(MGOS_EVENT_GRP_NET) > 2) {
+    fuzz_fail("%d net event handlers left behind", stub_handler_count(MGOS_EVENT_GRP_NET));
+  }
+}
+
+/*
+ * Start every input from the same state, whatever earlier inputs left behind (so saved inputs replay the same)
+ *
+ * Library keeps no state between tests except lock and test callback, and everything else is reset by a
+ * first test (ended by timeout), ran on cleared stubs.  run_test() and boot tests use the last callback set.
+ */
+static void fuzz_reset(void) {
+  stub_reset();
+  mgos_sys_config_set_provision_wifi_sta_ssid("TestNet");
+  mgos_provision_wifi_init();
+
+  memset(&s_fs, 0, sizeof(s_fs));
+  s_fs.starts = 1;
+  mgos_provision_wifi_test(fuzz_test_cb, NULL);
+  while (stub_fire_next_timer() != MGOS_INVALID_TIMER_ID) {
+  }
+  if (mgos_provision_wifi_is_test_running() || s_fs.verdicts != 1) {
+    fuzz_fail("first test did not end by timeout");
+  }
+
+  memset(&s_fs, 0, sizeof(s_fs));
+  s_step = 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  struct fuzz_input in = {data, size, 0};
+
+  s_input = &in;
+  s_inputs++;
+  fuzz_reset();
+
+  fuzz_configure(&in);
+  while (in.pos < in.size) {
+    s_step++;
+    s_total_steps++;
+    fuzz_op(&in);
+  }
+  fuzz_drain();
+
+  s_input = NULL;
+  return 0;
+}
+
+#ifndef PROVISION_WIFI_LIBFUZZER
+
+/* Standalone runner and benchmark */
+
+static uint64_t s_rng = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t fuzz_rand(void) {
+  s_rng ^= s_rng << 13;
+  s_rng ^= s_rng >> 7;
+  s_rng ^= s_rng << 17;
+  return s_rng;
+}
+
+static uint64_t fuzz_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int fuzz_cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void fuzz_report(const char *name, const char *unit, uint64_t *lat, int n, uint64_t total_ns) {
+  qsort(lat, (size_t) n, sizeof(*lat), fuzz_cmp_u64);
+  printf("%-28s %9d %-6s  %10.0f/s  p50 %6llu ns  p99 %6llu ns  max %8llu ns\n", name, n, unit,
+         n / (total_ns / 1e9), (unsigned long long) lat[n / 2], (unsigned long long) lat[(n * 99) / 100],
+         (unsigned long long) lat[n - 1]);
+}
+
+static void fuzz_bench_cb(bool success, const char *ssid, void *userdata) {
+  (*(int *) userdata)++;
+  (void) success;
+  (void) ssid;
+}
+
+/*
+ * Event handling throughput and per event latency, for net events while a test is running (handled by
+ * library) and while idle (ignored), and complete tests (start, associate, result)
+ */
+static void fuzz_bench(int n) {
+  static const int evs[] = {MGOS_NET_EV_CONNECTING, MGOS_NET_EV_CONNECTED, MGOS_NET_EV_DISCONNECTED};
+  uint64_t *lat = calloc((size_t) n, sizeof(*lat));
+  uint64_t start;
+  int results = 0;
+
+  stub_reset();
+  mgos_sys_config_set_provision_wifi_sta_ssid("TestNet");
+  mgos_sys_config_set_provision_wifi_attempts(0x7fffffff);
+  mgos_sys_config_set_provision_wifi_timeout(3600);
+  mgos_sys_config_set_provision_wifi_success_copy(false);
+
+  // Associations to another network while testing, which never ends the test
+  mgos_provision_wifi_test(fuzz_bench_cb, &results);
+  start = fuzz_now_ns();
+  for (int i = 0; i < n; i++) {
+    uint64_t t = fuzz_now_ns();
+    stub_net_event(evs[i % 3], "OtherNet");
+    lat[i] = fuzz_now_ns() - t;
+  }
+  fuzz_report("net events while testing", "events", lat, n, fuzz_now_ns() - start);
+  stub_fire_next_timer();
+
+  start = fuzz_now_ns();
+  for (int i = 0; i < n; i++) {
+    uint64_t t = fuzz_now_ns();
+    stub_net_event(evs[i % 3], "OtherNet");
+    lat[i] = fuzz_now_ns() - t;
+  }
+  fuzz_report("net events while idle", "events", lat, n, fuzz_now_ns() - start);
+
+  // Complete tests, from start until IP acquired result
+  results = 0;
+  start = fuzz_now_ns();
+  for (int i = 0; i < n; i++) {
+    uint64_t t = fuzz_now_ns();
+    mgos_provision_wifi_test(fuzz_bench_cb, &results);
+    stub_net_event(MGOS_NET_EV_CONNECTED, "TestNet");
+    lat[i] = fuzz_now_ns() - t;
+    stub_net_event(MGOS_NET_EV_DISCONNECTED, NULL);
+  }
+  fuzz_report("tests (start to result)", "tests", lat, n, fuzz_now_ns() - start);
+
+  if (results != n) {
+    fprintf(stderr, "benchmark got %d results for %d tests\n", results, n);
+    exit(1);
+  }
+
+  free(lat);
+}
+
+/*
+ * Outcome of last input, compared between two runs of the same input by -r
+ */
+struct fuzz_digest {
+  struct stub_stats stats;
+  int starts;
+  int verdicts;
+  unsigned long steps;
+  double uptime;
+  int results[6];
+};
+
+static void fuzz_get_digest(struct fuzz_digest *d) {
+  memset(d, 0, sizeof(*d));
+  d->stats = *stub_get_stats();
+  d->starts = s_fs.starts;
+  d->verdicts = s_fs.verdicts;
+  d->steps = s_step;
+  d->uptime = mgos_uptime();
+  d->results[0] = mgos_sys_config_get_provision_wifi_results_success();
+  d->results[1] = mgos_sys_config_get_provision_wifi_results_radio_ms();
+  d->results[2] = mgos_sys_config_get_provision_wifi_results_charge();
+  d->results[3] = mgos_sys_config_get_provision_wifi_results_rssi();
+  d->results[4] = mgos_sys_config_get_provision_wifi_results_rtt();
+  d->results[5] = mgos_sys_config_get_provision_wifi_results_ap_disconnects();
+}
+
+static int fuzz_file(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    perror(path);
+    return 1;
+  }
+
+  uint8_t buf[4096];
+  size_t len = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+
+  LLVMFuzzerTestOneInput(buf, len);
+  printf("%s: OK\n", path);
+  return 0;
+}
+
+static void fuzz_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-v] [-r] [-n ITERATIONS] [-s SEED] [--bench EVENTS] [FILE...]\n"
+          "  Runs random inputs (default 10000), or replays inputs from FILEs\n"
+          "  -r runs every random input twice, and checks both runs end the same\n",
+          prog);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  long iterations = 10000;
+  long bench = 0;
+  bool replay = false;
+  int files = 0;
+  int ret = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      stub_log_level = LL_DEBUG;
+    } else if (strcmp(argv[i], "-r") == 0) {
+      replay = true;
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      iterations = strtol(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      s_rng = strtoull(argv[++i], NULL, 0) * 0x9e3779b97f4a7c15ULL + 1;
+    } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+      bench = strtol(argv[++i], NULL, 0);
+    } else if (argv[i][0] == '-') {
+      fuzz_usage(argv[0]);
+    } else {
+      files++;
+    }
+  }
+
+  if (bench > 0) {
+    fuzz_bench((int) bench);
+    return 0;
+  }
+
+  if (files > 0) {
+    for (int i = 1; i < argc; i++) {
+      if (argv[i][0] == '-') {
+        if (strcmp(argv[i], "-v") != 0 && strcmp(argv[i], "-r") != 0) i++;
+        continue;
+      }
+      ret |= fuzz_file(argv[i]);
+    }
+    return ret;
+  }
+
+  uint8_t buf[512];
+  for (long i = 0; i < iterations; i++) {
+    size_t len = 8 + fuzz_rand() % (sizeof(buf) - 8);
+    for (size_t j = 0; j < len; j++) buf[j] = (uint8_t) fuzz_rand();
+    LLVMFuzzerTestOneInput(buf, len);
+
+    if (replay) {
+      // Second run starts after a different input (the first run) than the first one did
+      struct fuzz_digest first, second;
+      fuzz_get_digest(&first);
+      LLVMFuzzerTestOneInput(buf, len);
+      fuzz_get_digest(&second);
+      if (memcmp(&first, &second, sizeof(first)) != 0) {
+        s_input = &(struct fuzz_input){buf, len, 0};
+        fuzz_fail("second run of input ended differently (depends on earlier inputs)");
+      }
+    }
+  }
+
+  printf("%ld inputs, %lu steps, no invariant failures\n", iterations, s_total_steps);
+  return 0;
+}
+
+#endif /* PROVISION_WIFI_LIBFUZZER */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of Mongoose OS common/cs_dbg.h, logging is only printed when
+ * stub_log_level is raised (provision_wifi_fuzz -v)
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_CS_DBG_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_CS_DBG_H_
+
+#include <stdio.h>
+
+enum cs_log_level {
+  LL_NONE = -1,
+  LL_ERROR = 0,
+  LL_WARN = 1,
+  LL_INFO = 2,
+  LL_DEBUG = 3,
+  LL_VERBOSE_DEBUG = 4,
+};
+
+extern int stub_log_level;
+
+#define LOG(l, x)                  \
+  do {                             \
+    if ((int) (l) <= stub_log_level) { \
+      printf x;                    \
+      printf("\n");                \
+    }                              \
+  } while (0)
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_CS_DBG_H_ */
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of Mongoose OS event API
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_EVENT_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_EVENT_H_
+
+#include <stdbool.h>
+
+#define MGOS_EVENT_BASE(a, b, c) ((a) << 24 | (b) << 16 | (c) << 8)
+#define MGOS_EVENT_GRP_NET MGOS_EVENT_BASE('G', 'N', 'I')
+
+typedef void (*mgos_event_handler_t)(int ev, void *ev_data, void *userdata);
+
+bool mgos_event_add_handler(int ev, mgos_event_handler_t cb, void *userdata);
+bool mgos_event_add_group_handler(int evgrp, mgos_event_handler_t cb, void *userdata);
+bool mgos_event_remove_handler(int ev, mgos_event_handler_t cb, void *userdata);
+bool mgos_event_remove_group_handler(int evgrp, mgos_event_handler_t cb, void *userdata);
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_EVENT_H_ */
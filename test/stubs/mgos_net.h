@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of Mongoose OS net API
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_NET_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_NET_H_
+
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "mgos_event.h"
+
+enum mgos_net_event {
+  MGOS_NET_EV_DISCONNECTED = MGOS_EVENT_GRP_NET,
+  MGOS_NET_EV_CONNECTING,
+  MGOS_NET_EV_CONNECTED,
+  MGOS_NET_EV_IP_ACQUIRED,
+};
+
+enum mgos_net_if_type {
+  MGOS_NET_IF_TYPE_WIFI,
+  MGOS_NET_IF_TYPE_ETHERNET,
+};
+
+#define MGOS_NET_IF_WIFI_STA 0
+#define MGOS_NET_IF_WIFI_AP 1
+
+struct mgos_net_ip_info {
+  struct sockaddr_in ip;
+  struct sockaddr_in netmask;
+  struct sockaddr_in gw;
+};
+
+bool mgos_net_get_ip_info(enum mgos_net_if_type if_type, int if_instance, struct mgos_net_ip_info *ip_info);
+char *mgos_net_ip_to_str(const struct sockaddr_in *sin, char *out);
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_NET_H_ */
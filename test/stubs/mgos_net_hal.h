@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of Mongoose OS net HAL
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_NET_HAL_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_NET_HAL_H_
+
+#include "mgos_net.h"
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_NET_HAL_H_ */
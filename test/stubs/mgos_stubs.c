@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos_stubs.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/cs_dbg.h"
+#include "mgos.h"
+#include "mgos_mongoose.h"
+#include "mgos_provision_wifi_hal.h"
+#include "mgos_wifi.h"
+
+#define STUB_MAX_HANDLERS 32
+#define STUB_MAX_TIMERS 32
+#define STUB_MAX_INVOKE 32
+
+int stub_log_level = LL_NONE;
+
+static struct stub_stats s_stats;
+static bool s_save_fails = false;
+static bool s_dev_connect_fails = false;
+static int s_rssi = -60;
+static double s_now = 0;
+
+/* Config */
+
+struct mgos_config mgos_sys_config;
+
+#define X(name, def) static int s_cfg_##name;
+STUB_CONFIG_INTS(X)
+#undef X
+
+#define X(name, def) static char *s_cfg_##name;
+STUB_CONFIG_STRS(X)
+#undef X
+
+static void stub_set_str(char **dst, const char *v) {
+  free(*dst);
+  *dst = v != NULL ? strdup(v) : NULL;
+}
+
+#define X(name, def)                                                     \
+  int mgos_sys_config_get_##name(void) { return s_cfg_##name; }          \
+  void mgos_sys_config_set_##name(int v) { s_cfg_##name = v; }
+STUB_CONFIG_INTS(X)
+#undef X
+
+#define X(name, def)                                                                   \
+  const char *mgos_sys_config_get_##name(void) { return s_cfg_##name; }                \
+  void mgos_sys_config_set_##name(const char *v) { stub_set_str(&s_cfg_##name, v); }
+STUB_CONFIG_STRS(X)
+#undef X
+
+#define X(name)                                                                          \
+  const char *mgos_sys_config_get_provision_wifi_sta_##name(void) {                      \
+    return mgos_sys_config.provision_wifi_sta.name;                                      \
+  }                                                                                      \
+  void mgos_sys_config_set_provision_wifi_sta_##name(const char *v) {                    \
+    stub_set_str((char **) &mgos_sys_config.provision_wifi_sta.name, v);                 \
+  }                                                                                      \
+  const char *mgos_sys_config_get_wifi_sta_##name(void) {                                \
+    return mgos_sys_config.wifi.sta.name;                                                \
+  }                                                                                      \
+  void mgos_sys_config_set_wifi_sta_##name(const char *v) {                              \
+    stub_set_str((char **) &mgos_sys_config.wifi.sta.name, v);                           \
+  }
+STUB_CONFIG_STA_STRS(X)
+#undef X
+
+int mgos_sys_config_get_provision_wifi_sta_enable(void) { return mgos_sys_config.provision_wifi_sta.enable; }
+void mgos_sys_config_set_provision_wifi_sta_enable(int v) { mgos_sys_config.provision_wifi_sta.enable = v; }
+int mgos_sys_config_get_wifi_sta_enable(void) { return mgos_sys_config.wifi.sta.enable; }
+void mgos_sys_config_set_wifi_sta_enable(int v) { mgos_sys_config.wifi.sta.enable = v; }
+int mgos_sys_config_get_wifi_ap_enable(void) { return mgos_sys_config.wifi.ap.enable; }
+void mgos_sys_config_set_wifi_ap_enable(int v) { mgos_sys_config.wifi.ap.enable = v; }
+int mgos_sys_config_get_wifi_ap_channel(void) { return mgos_sys_config.wifi.ap.channel; }
+void mgos_sys_config_set_wifi_ap_channel(int v) { mgos_sys_config.wifi.ap.channel = v; }
+
+const struct mgos_config_provision_wifi_sta *mgos_sys_config_get_provision_wifi_sta(void) {
+  return &mgos_sys_config.provision_wifi_sta;
+}
+
+const struct mgos_config_wifi *mgos_sys_config_get_wifi(void) {
+  return &mgos_sys_config.wifi;
+}
+
+const struct mgos_config_wifi_ap *mgos_sys_config_get_wifi_ap(void) {
+  return &mgos_sys_config.wifi.ap;
+}
+
+bool save_cfg(const struct mgos_config *cfg, char **msg) {
+  s_stats.saves++;
+  if (s_save_fails) {
+    if (msg != NULL) *msg = strdup("stub save failure");
+    return false;
+  }
+  (void) cfg;
+  return true;
+}
+
+/* Events */
+
+struct stub_handler {
+  int ev;
+  bool group;
+  mgos_event_handler_t cb;
+  void *userdata;
+  bool active;
+};
+
+static struct stub_handler s_handlers[STUB_MAX_HANDLERS];
+
+static bool stub_add_handler(int ev, bool group, mgos_event_handler_t cb, void *userdata) {
+  for (int i = 0; i < STUB_MAX_HANDLERS; i++) {
+    if (!s_handlers[i].active) {
+      s_handlers[i] = (struct stub_handler){ev, group, cb, userdata, true};
+      return true;
+    }
+  }
+  fprintf(stderr, "stub: out of event handler slots\n");
+  abort();
+}
+
+static bool stub_remove_handler(int ev, bool group, mgos_event_handler_t cb, void *userdata) {
+  for (int i = 0; i < STUB_MAX_HANDLERS; i++) {
+    struct stub_handler *h = &s_handlers[i];
+    if (h->active && h->ev == ev && h->group == group && h->cb == cb && h->userdata == userdata) {
+      h->active = false;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool mgos_event_add_handler(int ev, mgos_event_handler_t cb, void *userdata) {
+  return stub_add_handler(ev, false, cb, userdata);
+}
+
+bool mgos_event_add_group_handler(int evgrp, mgos_event_handler_t cb, void *userdata) {
+  return stub_add_handler(evgrp, true, cb, userdata);
+}
+
+bool mgos_event_remove_handler(int ev, mgos_event_handler_t cb, void *userdata) {
+  return stub_remove_handler(ev, false, cb, userdata);
+}
+
+bool mgos_event_remove_group_handler(int evgrp, mgos_event_handler_t cb, void *userdata) {
+  return stub_remove_handler(evgrp, true, cb, userdata);
+}
+
+static bool stub_handler_matches(const struct stub_handler *h, int ev) {
+  return h->active && (h->group ? (ev & ~0xff) == h->ev : ev == h->ev);
+}
+
+static void stub_trigger(int ev, void *ev_data) {
+  struct stub_handler snapshot[STUB_MAX_HANDLERS];
+  memcpy(snapshot, s_handlers, sizeof(snapshot));
+
+  for (int i = 0; i < STUB_MAX_HANDLERS; i++) {
+    // Handlers removed by an earlier handler of this event are skipped
+    if (stub_handler_matches(&snapshot[i], ev) && stub_handler_matches(&s_handlers[i], ev) &&
+        s_handlers[i].cb == snapshot[i].cb) {
+      snapshot[i].cb(ev, ev_data, snapshot[i].userdata);
+    }
+  }
+}
+
+int stub_handler_count(int ev) {
+  int count = 0;
+  for (int i = 0; i < STUB_MAX_HANDLERS; i++) {
+    if (s_handlers[i].active && s_handlers[i].ev == ev) count++;
+  }
+  return count;
+}
+
+bool stub_handler_duplicates(void) {
+  for (int i = 0; i < STUB_MAX_HANDLERS; i++) {
+    for (int j = i + 1; j < STUB_MAX_HANDLERS; j++) {
+      const struct stub_handler *a = &s_handlers[i], *b = &s_handlers[j];
+      if (a->active && b->active && a->ev == b->ev && a->group == b->group && a->cb == b->cb &&
+          a->userdata == b->userdata) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/* Timers */
+
+struct stub_timer {
+  mgos_timer_id id;
+  double due;
+  double interval;
+  bool repeat;
+  timer_callback cb;
+  void *arg;
+};
+
+static struct stub_timer s_timers[STUB_MAX_TIMERS];
+static mgos_timer_id s_last_timer_id = MGOS_INVALID_TIMER_ID;
+
+mgos_timer_id mgos_set_timer(int msecs, int flags, timer_callback cb, void *cb_arg) {
+  for (int i = 0; i < STUB_MAX_TIMERS; i++) {
+    if (s_timers[i].id == MGOS_INVALID_TIMER_ID) {
+      double interval = (msecs > 0 ? msecs : 0) / 1000.0;
+      s_timers[i] = (struct stub_timer){++s_last_timer_id, s_now + interval, interval,
+                                        (flags & MGOS_TIMER_REPEAT) != 0, cb, cb_arg};
+      s_stats.timers_active++;
+      return s_last_timer_id;
+    }
+  }
+  fprintf(stderr, "stub: out of timer slots\n");
+  abort();
+}
+
+void mgos_clear_timer(mgos_timer_id id) {
+  if (id == MGOS_INVALID_TIMER_ID) return;
+  for (int i = 0; i < STUB_MAX_TIMERS; i++) {
+    if (s_timers[i].id == id) {
+      s_timers[i].id = MGOS_INVALID_TIMER_ID;
+      s_stats.timers_active--;
+      return;
+    }
+  }
+}
+
+double mgos_uptime(void) {
+  return s_now;
+}
+
+mgos_timer_id stub_fire_next_timer(void) {
+  struct stub_timer *next = NULL;
+  for (int i = 0; i < STUB_MAX_TIMERS; i++) {
+    if (s_timers[i].id != MGOS_INVALID_TIMER_ID && (next == NULL || s_timers[i].due < next->due)) {
+      next = &s_timers[i];
+    }
+  }
+  if (next == NULL) return MGOS_INVALID_TIMER_ID;
+
+  struct stub_timer t = *next;
+  if (t.due > s_now) s_now = t.due;
+  if (t.repeat) {
+    // Repeating timers with 0 interval still move time forward
+    next->due = s_now + (t.interval > 0 ? t.interval : 0.001);
+  } else {
+    next->id = MGOS_INVALID_TIMER_ID;
+    s_stats.timers_active--;
+  }
+
+  t.cb(t.arg);
+  return t.id;
+}
+
+double stub_next_timer_due(void) {
+  double due = -1;
+  for (int i = 0; i < STUB_MAX_TIMERS; i++) {
+    if (s_timers[i].id != MGOS_INVALID_TIMER_ID && (due < 0 || s_timers[i].due < due)) {
+      due = s_timers[i].due;
+    }
+  }
+  return due;
+}
+
+mgos_timer_id stub_last_timer_id(void) {
+  return s_last_timer_id;
+}
+
+void stub_advance(double seconds) {
+  s_now += seconds;
+}
+
+/* System */
+
+struct mgos_rlock_type {
+  int depth;
+};
+
+struct mgos_rlock_type *mgos_rlock_create(void) {
+  s_stats.rlocks_created++;
+  return calloc(1, sizeof(struct mgos_rlock_type));
+}
+
+void mgos_rlock(struct mgos_rlock_type *l) {
+  if (l == NULL) {
+    s_stats.rlock_errors++;
+    return;
+  }
+  l->depth++;
+}
+
+void mgos_runlock(struct mgos_rlock_type *l) {
+  if (l == NULL || l->depth <= 0) {
+    s_stats.rlock_errors++;
+    return;
+  }
+  l->depth--;
+}
+
+struct stub_invoke {
+  mgos_cb_t cb;
+  void *arg;
+};
+
+static struct stub_invoke s_invoke[STUB_MAX_INVOKE];
+
+bool mgos_invoke_cb(mgos_cb_t cb, void *arg, bool from_isr) {
+  if (s_stats.invoke_pending >= STUB_MAX_INVOKE) return false;
+  s_invoke[s_stats.invoke_pending++] = (struct stub_invoke){cb, arg};
+  (void) from_isr;
+  return true;
+}
+
+bool stub_run_invoked(void) {
+  if (s_stats.invoke_pending == 0) return false;
+  struct stub_invoke inv = s_invoke[0];
+  memmove(&s_invoke[0], &s_invoke[1], (size_t)(--s_stats.invoke_pending) * sizeof(s_invoke[0]));
+  inv.cb(inv.arg);
+  return true;
+}
+
+void mgos_msleep(uint32_t msecs) {
+  s_now += msecs / 1000.0;
+}
+
+void mgos_system_restart(void) {
+  s_stats.restarts++;
+}
+
+/* WiFi */
+
+static enum mgos_wifi_status s_wifi_status = MGOS_WIFI_DISCONNECTED;
+static char *s_connected_ssid = NULL;
+static mgos_wifi_scan_cb_t s_scan_cb = NULL;
+static void *s_scan_arg = NULL;
+
+bool mgos_wifi_setup(struct mgos_config_wifi *cfg) {
+  s_stats.wifi_setups++;
+  (void) cfg;
+  return true;
+}
+
+bool mgos_wifi_setup_ap(const struct mgos_config_wifi_ap *cfg) {
+  s_stats.ap_setups++;
+  (void) cfg;
+  return true;
+}
+
+bool mgos_wifi_validate_sta_cfg(const struct mgos_config_wifi_sta *cfg, char **msg) {
+  if (cfg->enable && (cfg->ssid == NULL || cfg->ssid[0] == '\0')) {
+    *msg = strdup("SSID is required");
+    return false;
+  }
+  return true;
+}
+
+bool mgos_wifi_disconnect(void) {
+  s_wifi_status = MGOS_WIFI_DISCONNECTED;
+  stub_set_str(&s_connected_ssid, NULL);
+  return true;
+}
+
+enum mgos_wifi_status mgos_wifi_get_status(void) {
+  return s_wifi_status;
+}
+
+char *mgos_wifi_get_connected_ssid(void) {
+  return s_connected_ssid != NULL ? strdup(s_connected_ssid) : NULL;
+}
+
+int mgos_wifi_sta_get_rssi(void) {
+  return s_rssi;
+}
+
+void mgos_wifi_scan(mgos_wifi_scan_cb_t cb, void *arg) {
+  // Same as wifi lib, a scan already in progress fails
+  if (s_scan_cb != NULL) {
+    cb(-1, NULL, arg);
+    return;
+  }
+  s_scan_cb = cb;
+  s_scan_arg = arg;
+  s_stats.scans_pending = 1;
+}
+
+bool stub_complete_scan(const char *ssid, int channel) {
+  if (s_scan_cb == NULL) return false;
+
+  struct mgos_wifi_scan_result res;
+  memset(&res, 0, sizeof(res));
+  if (ssid != NULL) {
+    strncpy(res.ssid, ssid, sizeof(res.ssid) - 1);
+    res.channel = channel;
+    res.rssi = s_rssi;
+  }
+
+  mgos_wifi_scan_cb_t cb = s_scan_cb;
+  s_scan_cb = NULL;
+  s_stats.scans_pending = 0;
+  cb(ssid != NULL ? 1 : 0, &res, s_scan_arg);
+  return true;
+}
+
+void stub_drop_scan(void) {
+  s_scan_cb = NULL;
+  s_scan_arg = NULL;
+  s_stats.scans_pending = 0;
+}
+
+bool mgos_wifi_dev_sta_setup(const struct mgos_config_wifi_sta *cfg) {
+  (void) cfg;
+  return true;
+}
+
+bool mgos_wifi_dev_sta_connect(void) {
+  return !s_dev_connect_fails;
+}
+
+bool mgos_wifi_dev_sta_disconnect(void) {
+  return mgos_wifi_disconnect();
+}
+
+enum mgos_wifi_status mgos_wifi_dev_sta_get_status(void) {
+  return s_wifi_status;
+}
+
+void mgos_wifi_dev_init(void) {
+}
+
+void mgos_wifi_dev_deinit(void) {
+}
+
+void stub_net_event(int ev, const char *ssid) {
+  switch (ev) {
+    case MGOS_NET_EV_DISCONNECTED:
+      s_wifi_status = MGOS_WIFI_DISCONNECTED;
+      stub_set_str(&s_connected_ssid, NULL);
+      break;
+    case MGOS_NET_EV_CONNECTING:
+      s_wifi_status = MGOS_WIFI_CONNECTING;
+      break;
+    case MGOS_NET_EV_CONNECTED:
+      s_wifi_status = MGOS_WIFI_CONNECTED;
+      stub_set_str(&s_connected_ssid, ssid);
+      break;
+    case MGOS_NET_EV_IP_ACQUIRED:
+      s_wifi_status = MGOS_WIFI_IP_ACQUIRED;
+      stub_set_str(&s_connected_ssid, ssid);
+      break;
+  }
+  stub_trigger(ev, NULL);
+}
+
+void stub_ap_event(int ev) {
+  stub_trigger(ev, NULL);
+}
+
+/* Net */
+
+bool mgos_net_get_ip_info(enum mgos_net_if_type if_type, int if_instance, struct mgos_net_ip_info *ip_info) {
+  if (if_type != MGOS_NET_IF_TYPE_WIFI || if_instance != MGOS_NET_IF_WIFI_STA || s_wifi_status != MGOS_WIFI_IP_ACQUIRED) {
+    return false;
+  }
+  memset(ip_info, 0, sizeof(*ip_info));
+  ip_info->ip.sin_addr.s_addr = htonl(0xc0a80164); /* 192.168.1.100 */
+  ip_info->gw.sin_addr.s_addr = htonl(0xc0a80101); /* 192.168.1.1 */
+  return true;
+}
+
+char *mgos_net_ip_to_str(const struct sockaddr_in *sin, char *out) {
+  inet_ntop(AF_INET, &sin->sin_addr, out, 16);
+  return out;
+}
+
+/* Mongoose */
+
+static struct mg_connection *s_conns = NULL;
+static int s_mgr;
+
+struct mg_mgr *mgos_get_mgr(void) {
+  return (struct mg_mgr *) &s_mgr;
+}
+
+struct mg_connection *mg_connect(struct mg_mgr *mgr, const char *address, mg_event_handler_t handler, void *user_data) {
+  struct mg_connection *nc = calloc(1, sizeof(*nc));
+  nc->handler = handler;
+  nc->user_data = user_data;
+
+  // Append, so oldest connection is first
+  struct mg_connection **p = &s_conns;
+  while (*p != NULL) p = &(*p)->next;
+  *p = nc;
+
+  s_stats.conns_open++;
+  (void) mgr;
+  (void) address;
+  return nc;
+}
+
+bool stub_connect_result(int status) {
+  for (struct mg_connection *nc = s_conns; nc != NULL; nc = nc->next) {
+    if (!(nc->flags & MG_F_CLOSE_IMMEDIATELY)) {
+      nc->handler(nc, MG_EV_CONNECT, &status, nc->user_data);
+      // Mongoose closes connections that failed to connect
+      if (status != 0) nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+      return true;
+    }
+  }
+  return false;
+}
+
+void stub_poll(void) {
+  struct mg_connection **p = &s_conns;
+  while (*p != NULL) {
+    struct mg_connection *nc = *p;
+    if (nc->flags & MG_F_CLOSE_IMMEDIATELY) {
+      *p = nc->next;
+      nc->handler(nc, MG_EV_CLOSE, NULL, nc->user_data);
+      free(nc);
+      s_stats.conns_open--;
+    } else {
+      p = &nc->next;
+    }
+  }
+}
+
+/* Harness */
+
+void stub_reset(void) {
+  // Nothing from an earlier run is kept, so every run starts from the same state
+  memset(s_handlers, 0, sizeof(s_handlers));
+  memset(s_timers, 0, sizeof(s_timers));
+  memset(s_invoke, 0, sizeof(s_invoke));
+  while (s_conns != NULL) {
+    struct mg_connection *nc = s_conns;
+    s_conns = nc->next;
+    free(nc);
+  }
+  s_scan_cb = NULL;
+  s_scan_arg = NULL;
+  memset(&s_stats, 0, sizeof(s_stats));
+  s_now = 0;
+
+#define X(name, def) s_cfg_##name = def;
+  STUB_CONFIG_INTS(X)
+#undef X
+#define X(name, def) stub_set_str(&s_cfg_##name, def);
+  STUB_CONFIG_STRS(X)
+#undef X
+#define X(name)                                                          \
+  stub_set_str((char **) &mgos_sys_config.provision_wifi_sta.name, NULL); \
+  stub_set_str((char **) &mgos_sys_config.wifi.sta.name, NULL);
+  STUB_CONFIG_STA_STRS(X)
+#undef X
+  mgos_sys_config.provision_wifi_sta.enable = 1;
+  mgos_sys_config.wifi.sta.enable = 0;
+  mgos_sys_config.wifi.ap.enable = 1;
+  mgos_sys_config.wifi.ap.channel = 6;
+
+  s_wifi_status = MGOS_WIFI_DISCONNECTED;
+  stub_set_str(&s_connected_ssid, NULL);
+  s_save_fails = false;
+  s_dev_connect_fails = false;
+  s_rssi = -60;
+}
+
+const struct stub_stats *stub_get_stats(void) {
+  return &s_stats;
+}
+
+void stub_set_save_fails(bool fails) {
+  s_save_fails = fails;
+}
+
+void stub_set_dev_connect_fails(bool fails) {
+  s_dev_connect_fails = fails;
+}
+
+void stub_set_rssi(int rssi) {
+  s_rssi = rssi;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Harness side of the host stubs, used to drive events, timers and scans into the library, and to
+ * read counters used for invariant checks.
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_STUBS_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_STUBS_H_
+
+#include <stdbool.h>
+
+#include "mgos_timers.h"
+
+struct stub_stats {
+  int saves;           // save_cfg() calls
+  int rlocks_created;  // mgos_rlock_create() calls
+  int rlock_errors;    // Lock used before created, or unlocked more than locked
+  int wifi_setups;     // mgos_wifi_setup() calls
+  int ap_setups;       // mgos_wifi_setup_ap() calls
+  int restarts;        // mgos_system_restart() calls
+  int timers_active;   // Timers currently set
+  int conns_open;      // mg_connect() connections not closed yet
+  int scans_pending;   // mgos_wifi_scan() calls without results delivered
+  int invoke_pending;  // mgos_invoke_cb() callbacks not ran yet
+};
+
+extern int stub_log_level;
+
+/* Reset config to defaults, wifi state to disconnected, and remove all handlers, timers, connections, scans,
+ * invoked callbacks and stats (timer ids keep increasing, so an id left from an earlier run never matches) */
+void stub_reset(void);
+
+const struct stub_stats *stub_get_stats(void);
+
+/* Make save_cfg() fail, returning an allocated error message */
+void stub_set_save_fails(bool fails);
+/* Make mgos_wifi_dev_sta_connect() fail */
+void stub_set_dev_connect_fails(bool fails);
+/* RSSI returned by mgos_wifi_sta_get_rssi(), 0 is not available */
+void stub_set_rssi(int rssi);
+
+/* Update wifi state for `ev`, and dispatch it to net handlers (`ssid` is used for CONNECTED and IP_ACQUIRED) */
+void stub_net_event(int ev, const char *ssid);
+/* Dispatch an AP client event to handlers */
+void stub_ap_event(int ev);
+
+/* Advance time to, and run, the next timer.  Returns id of timer ran, or MGOS_INVALID_TIMER_ID when none are set */
+mgos_timer_id stub_fire_next_timer(void);
+/* Id of last timer set */
+mgos_timer_id stub_last_timer_id(void);
+/* Uptime when next timer is due, -1 when none are set */
+double stub_next_timer_due(void);
+/* Move uptime forward (without firing timers) */
+void stub_advance(double seconds);
+
+/* Run oldest mgos_invoke_cb() callback, returns false when none are pending */
+bool stub_run_invoked(void);
+
+/* Deliver results for pending scan, `ssid` NULL for no results, returns false when no scan is pending */
+bool stub_complete_scan(const char *ssid, int channel);
+/* Drop pending scan without calling its callback (scan callback is not guaranteed to be called) */
+void stub_drop_scan(void);
+
+/* Deliver MG_EV_CONNECT with `status` to oldest open connection, returns false when none are open */
+bool stub_connect_result(int status);
+/* Close connections flagged for closing (same as mongoose poll) */
+void stub_poll(void);
+
+/* Number of handlers registered for `ev` (or group), and whether any handler is registered twice */
+int stub_handler_count(int ev);
+bool stub_handler_duplicates(void);
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_STUBS_H_ */
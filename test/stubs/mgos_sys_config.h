@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of the Mongoose OS generated mgos_sys_config.h, only containing the values used by this
+ * library.  Defaults must match mos.yml.  Booleans are ints, same as generated Mongoose OS config.
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_SYS_CONFIG_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_SYS_CONFIG_H_
+
+#include <stdbool.h>
+
+#define STUB_CONFIG_STA_STRS(X) \
+  X(ssid)                       \
+  X(pass)                       \
+  X(user)                       \
+  X(anon_identity)              \
+  X(cert)                       \
+  X(key)                        \
+  X(ca_cert)                    \
+  X(ip)                         \
+  X(netmask)                    \
+  X(gw)                         \
+  X(nameserver)                 \
+  X(dhcp_hostname)
+
+#define STUB_CONFIG_INTS(X)                 \
+  X(provision_wifi_attempts, 15)            \
+  X(provision_wifi_timeout, 30)             \
+  X(provision_wifi_reconnect, 1)            \
+  X(provision_wifi_boot_enable, 0)          \
+  X(provision_wifi_boot_delay, 10)          \
+  X(provision_wifi_success_clear, 0)        \
+  X(provision_wifi_success_copy, 1)         \
+  X(provision_wifi_success_enable, 1)       \
+  X(provision_wifi_success_reboot, 0)       \
+  X(provision_wifi_success_disable_ap, 0)   \
+  X(provision_wifi_success_disconnect, 0)   \
+  X(provision_wifi_fail_clear, 0)           \
+  X(provision_wifi_fail_reboot, 0)          \
+  X(provision_wifi_energy_sta_ma, 120)      \
+  X(provision_wifi_energy_idle_ma, 100)     \
+  X(provision_wifi_energy_reconnect, 5)     \
+  X(provision_wifi_energy_budget, 0)        \
+  X(provision_wifi_quality_enable, 0)       \
+  X(provision_wifi_quality_samples, 5)      \
+  X(provision_wifi_quality_interval, 200)   \
+  X(provision_wifi_quality_min_rssi, -75)   \
+  X(provision_wifi_quality_max_rtt, 200)    \
+  X(provision_wifi_quality_port, 80)        \
+  X(provision_wifi_quality_reject, 0)       \
+  X(provision_wifi_coexist_enable, 0)       \
+  X(provision_wifi_coexist_notice, 2000)    \
+  X(provision_wifi_coexist_scan_timeout, 5) \
+  X(provision_wifi_results_success, 0)      \
+  X(provision_wifi_results_radio_ms, 0)     \
+  X(provision_wifi_results_charge, 0)       \
+  X(provision_wifi_results_reconnect_ms, 0) \
+  X(provision_wifi_results_rssi, 0)         \
+  X(provision_wifi_results_rtt, -1)         \
+  X(provision_wifi_results_weak, 0)         \
+  X(provision_wifi_results_ap_disconnects, 0) \
+  X(provision_wifi_results_reassoc_ms, 0)
+
+#define STUB_CONFIG_STRS(X)                 \
+  X(provision_wifi_energy_action, "abort")  \
+  X(provision_wifi_results_ssid, "")        \
+  X(provision_wifi_results_reason, "")
+
+struct mgos_config_wifi_sta {
+  int enable;
+#define X(name) const char *name;
+  STUB_CONFIG_STA_STRS(X)
+#undef X
+};
+
+/* Same layout as mgos_config_wifi_sta, the library casts between them */
+struct mgos_config_provision_wifi_sta {
+  int enable;
+#define X(name) const char *name;
+  STUB_CONFIG_STA_STRS(X)
+#undef X
+};
+
+struct mgos_config_wifi_ap {
+  int enable;
+  const char *ssid;
+  const char *pass;
+  int channel;
+};
+
+struct mgos_config_wifi {
+  struct mgos_config_wifi_sta sta;
+  struct mgos_config_wifi_ap ap;
+};
+
+struct mgos_config {
+  struct mgos_config_wifi wifi;
+  struct mgos_config_provision_wifi_sta provision_wifi_sta;
+};
+
+extern struct mgos_config mgos_sys_config;
+
+bool save_cfg(const struct mgos_config *cfg, char **msg);
+
+#define X(name, def)                       \
+  int mgos_sys_config_get_##name(void);    \
+  void mgos_sys_config_set_##name(int v);
+STUB_CONFIG_INTS(X)
+#undef X
+
+#define X(name, def)                              \
+  const char *mgos_sys_config_get_##name(void);   \
+  void mgos_sys_config_set_##name(const char *v);
+STUB_CONFIG_STRS(X)
+#undef X
+
+#define X(name)                                                 \
+  const char *mgos_sys_config_get_provision_wifi_sta_##name(void); \
+  void mgos_sys_config_set_provision_wifi_sta_##name(const char *v); \
+  const char *mgos_sys_config_get_wifi_sta_##name(void);        \
+  void mgos_sys_config_set_wifi_sta_##name(const char *v);
+STUB_CONFIG_STA_STRS(X)
+#undef X
+
+int mgos_sys_config_get_provision_wifi_sta_enable(void);
+void mgos_sys_config_set_provision_wifi_sta_enable(int v);
+int mgos_sys_config_get_wifi_sta_enable(void);
+void mgos_sys_config_set_wifi_sta_enable(int v);
+int mgos_sys_config_get_wifi_ap_enable(void);
+void mgos_sys_config_set_wifi_ap_enable(int v);
+int mgos_sys_config_get_wifi_ap_channel(void);
+void mgos_sys_config_set_wifi_ap_channel(int v);
+
+const struct mgos_config_provision_wifi_sta *mgos_sys_config_get_provision_wifi_sta(void);
+const struct mgos_config_wifi *mgos_sys_config_get_wifi(void);
+const struct mgos_config_wifi_ap *mgos_sys_config_get_wifi_ap(void);
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_SYS_CONFIG_H_ */
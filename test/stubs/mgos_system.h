@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of Mongoose OS system API
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_SYSTEM_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_SYSTEM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*mgos_cb_t)(void *arg);
+
+struct mgos_rlock_type;
+
+struct mgos_rlock_type *mgos_rlock_create(void);
+void mgos_rlock(struct mgos_rlock_type *l);
+void mgos_runlock(struct mgos_rlock_type *l);
+
+bool mgos_invoke_cb(mgos_cb_t cb, void *arg, bool from_isr);
+void mgos_msleep(uint32_t msecs);
+void mgos_system_restart(void);
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_SYSTEM_H_ */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of the Mongoose OS wifi library API
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_WIFI_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_WIFI_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mgos_event.h"
+#include "mgos_sys_config.h"
+
+#define MGOS_WIFI_EV_BASE MGOS_EVENT_BASE('W', 'F', 'I')
+
+enum mgos_wifi_event {
+  MGOS_WIFI_EV_AP_STA_CONNECTED = MGOS_WIFI_EV_BASE,
+  MGOS_WIFI_EV_AP_STA_DISCONNECTED,
+};
+
+enum mgos_wifi_status {
+  MGOS_WIFI_DISCONNECTED = 0,
+  MGOS_WIFI_CONNECTING = 1,
+  MGOS_WIFI_CONNECTED = 2,
+  MGOS_WIFI_IP_ACQUIRED = 3,
+};
+
+struct mgos_wifi_scan_result {
+  char ssid[33];
+  uint8_t bssid[6];
+  int auth_mode;
+  int channel;
+  int rssi;
+};
+
+typedef void (*mgos_wifi_scan_cb_t)(int num_res, struct mgos_wifi_scan_result *res, void *arg);
+
+bool mgos_wifi_setup(struct mgos_config_wifi *cfg);
+bool mgos_wifi_setup_ap(const struct mgos_config_wifi_ap *cfg);
+bool mgos_wifi_validate_sta_cfg(const struct mgos_config_wifi_sta *cfg, char **msg);
+bool mgos_wifi_disconnect(void);
+enum mgos_wifi_status mgos_wifi_get_status(void);
+char *mgos_wifi_get_connected_ssid(void);
+int mgos_wifi_sta_get_rssi(void);
+void mgos_wifi_scan(mgos_wifi_scan_cb_t cb, void *arg);
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MGOS_WIFI_H_ */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2018 Myles McNamara
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of the mongoose connection API used by the link quality probe
+ */
+
+#ifndef SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MONGOOSE_H_
+#define SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MONGOOSE_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#define MG_EV_CONNECT 2
+#define MG_EV_CLOSE 5
+
+#define MG_F_CLOSE_IMMEDIATELY (1 << 11)
+
+struct mg_mgr;
+struct mg_connection;
+
+typedef void (*mg_event_handler_t)(struct mg_connection *nc, int ev, void *ev_data, void *user_data);
+
+struct mg_connection {
+  struct mg_connection *next;
+  unsigned long flags;
+  mg_event_handler_t handler;
+  void *user_data;
+};
+
+struct mg_connection *mg_connect(struct mg_mgr *mgr, const char *address, mg_event_handler_t handler, void *user_data);
+
+#endif /* SMYLES_MOS_LIBS_PROVISION_WIFI_TEST_STUBS_MONGOOSE_H_ */